@@ -8,6 +8,7 @@ layout(std140, binding = 1) uniform Matrices
 {
 	mat4 projection;
 	mat4 view;
+	mat4 viewProjection;
 };
 
 out vec2 v_TexCoord;
@@ -16,7 +17,7 @@ uniform mat4 u_ModelMatrix;
 
 void main()
 {
-	gl_Position = projection * view * u_ModelMatrix * position;
+	gl_Position = viewProjection * u_ModelMatrix * position;
 	v_TexCoord = texCoord;
 };
 
@@ -0,0 +1,183 @@
+#shader compute
+#version 460 core
+
+layout(local_size_x = 64) in;
+
+layout(std430, binding = 0) readonly buffer modelMatrices
+{
+	mat4 model[];
+};
+
+// CompactInstance, 7 uints per instance: position xyz, rotation, scale xy, scale z, color
+layout(std430, binding = 3) readonly buffer compactInstances
+{
+	uint instanceData[];
+};
+
+layout(std140, binding = 1) uniform Matrices
+{
+	mat4 projection;
+	mat4 view;
+	mat4 viewProjection;
+};
+
+layout(std430, binding = 4) writeonly buffer visibleInstances
+{
+	uint visible[];
+};
+
+// CullCommands: an indirect draw per phase and the number of instances the early phase left to the late one.
+// Instance counts are reset to 0 before the early dispatch.
+layout(std430, binding = 5) buffer drawCommands
+{
+	uint earlyVertexCount;
+	uint earlyInstanceCount;
+	uint earlyFirstVertex;
+	uint earlyBaseInstance;
+	uint lateVertexCount;
+	uint lateInstanceCount;
+	uint lateFirstVertex;
+	uint lateBaseInstance;
+	uint rejectedCount;
+};
+
+// early phase: in frustum but behind the old depth, late phase: the ones to test again
+layout(std430, binding = 6) buffer rejectedInstances
+{
+	uint rejected[];
+};
+
+uniform uint u_InstanceCount;
+uniform bool u_Compact;
+uniform bool u_Occlusion;
+uniform bool u_Late;
+
+uniform sampler2D u_Pyramid;
+
+// corners of the unit cube are at +-0.5
+const float CubeRadius = 0.8660254;
+
+shared uint groupCount;
+shared uint groupBase;
+
+bool InFrustum(vec4 sphere)
+{
+	// Gribb-Hartmann: planes are row 3 +- rows 0..2 of the view projection
+	vec4 w = vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+	for (int i = 0; i < 3; i++)
+	{
+		vec4 row = vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		vec4 near = w + row;
+		vec4 far = w - row;
+		if (dot(near.xyz, sphere.xyz) + near.w < -sphere.w * length(near.xyz))
+			return false;
+		if (dot(far.xyz, sphere.xyz) + far.w < -sphere.w * length(far.xyz))
+			return false;
+	}
+	return true;
+}
+
+// Projects the sphere to a screen space box (2D Polyhedral Bounds of a Clipped, Perspective-Projected
+// 3D Sphere, Mara and McGuire 2013) and compares its nearest depth with the farthest depth under the box
+bool IsOccluded(vec4 sphere)
+{
+	vec3 center = (view * vec4(sphere.xyz, 1.0)).xyz;
+	float radius = sphere.w;
+	float depth = -center.z; // camera looks down -z
+
+	float zNear = projection[3][2] / (projection[2][2] - 1.0);
+	if (depth - radius < zNear)
+		return false;
+
+	vec2 cx = vec2(center.x, depth);
+	vec2 vx = vec2(sqrt(dot(cx, cx) - radius * radius), radius);
+	vec2 minX = mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
+	vec2 maxX = mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
+
+	vec2 cy = vec2(center.y, depth);
+	vec2 vy = vec2(sqrt(dot(cy, cy) - radius * radius), radius);
+	vec2 minY = mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
+	vec2 maxY = mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
+
+	vec4 box = vec4(minX.x / minX.y * projection[0][0], minY.x / minY.y * projection[1][1],
+		maxX.x / maxX.y * projection[0][0], maxY.x / maxY.y * projection[1][1]);
+	box = clamp(box * 0.5 + 0.5, 0.0, 1.0);
+
+	// the level where the box covers at most 2x2 texels
+	ivec2 baseSize = textureSize(u_Pyramid, 0);
+	vec2 size = (box.zw - box.xy) * vec2(baseSize);
+	int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, textureQueryLevels(u_Pyramid) - 1);
+
+	// derived instead of queried, textureSize with a per-instance lod is unreliable on llvmpipe
+	ivec2 levelSize = max(baseSize >> level, ivec2(1));
+	ivec2 low = min(ivec2(box.xy * vec2(levelSize)), levelSize - 1);
+	ivec2 high = min(ivec2(box.zw * vec2(levelSize)), levelSize - 1);
+
+	float occluderDepth = max(max(texelFetch(u_Pyramid, low, level).r, texelFetch(u_Pyramid, ivec2(high.x, low.y), level).r),
+		max(texelFetch(u_Pyramid, ivec2(low.x, high.y), level).r, texelFetch(u_Pyramid, high, level).r));
+
+	// window depth of the nearest point on the sphere
+	float nearZ = -(depth - radius);
+	float sphereDepth = (projection[2][2] * nearZ + projection[3][2]) / -nearZ * 0.5 + 0.5;
+
+	return sphereDepth > occluderDepth;
+}
+
+vec4 BoundingSphere(uint id)
+{
+	if (u_Compact)
+	{
+		uint base = id * 7u;
+		vec3 position = uintBitsToFloat(uvec3(instanceData[base], instanceData[base + 1u], instanceData[base + 2u]));
+		vec3 scale = abs(vec3(unpackHalf2x16(instanceData[base + 4u]), unpackHalf2x16(instanceData[base + 5u]).x));
+		return vec4(position, CubeRadius * max(scale.x, max(scale.y, scale.z)));
+	}
+
+	mat4 m = model[id];
+	float scale = sqrt(max(dot(m[0].xyz, m[0].xyz), max(dot(m[1].xyz, m[1].xyz), dot(m[2].xyz, m[2].xyz))));
+	return vec4(m[3].xyz, CubeRadius * scale);
+}
+
+void main()
+{
+	if (gl_LocalInvocationIndex == 0u)
+		groupCount = 0u;
+	barrier();
+
+	uint index = gl_GlobalInvocationID.x;
+	uint id = 0u;
+	bool isVisible = false;
+
+	if (u_Late)
+	{
+		// only what the early phase rejected, against the depth of what it drew
+		if (index < rejectedCount)
+		{
+			id = rejected[index];
+			isVisible = !IsOccluded(BoundingSphere(id));
+		}
+	}
+	else if (index < u_InstanceCount)
+	{
+		id = index;
+		vec4 sphere = BoundingSphere(id);
+		if (InFrustum(sphere))
+		{
+			isVisible = !u_Occlusion || !IsOccluded(sphere);
+			if (!isVisible)
+				rejected[atomicAdd(rejectedCount, 1u)] = id;
+		}
+	}
+
+	// compact within the group first so there's a single global atomic per 64 instances
+	uint slot = isVisible ? atomicAdd(groupCount, 1u) : 0u;
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0u && groupCount > 0u)
+		groupBase = u_Late ? atomicAdd(lateInstanceCount, groupCount) : atomicAdd(earlyInstanceCount, groupCount);
+	barrier();
+
+	if (isVisible)
+		visible[groupBase + slot] = id;
+}
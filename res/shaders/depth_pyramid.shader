@@ -0,0 +1,43 @@
+#shader compute
+#version 460 core
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// level 0 reads the copied scene depth, every other level the one below it
+uniform sampler2D u_Depth;
+layout(r32f, binding = 0) readonly uniform image2D u_Source;
+layout(r32f, binding = 1) writeonly uniform image2D u_Destination;
+
+uniform int u_Level;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(u_Destination);
+	if (any(greaterThanEqual(texel, size)))
+		return;
+
+	float depth = 0.0;
+	if (u_Level == 0)
+	{
+		// level 0 is the viewport rounded down to a power of two, so a texel covers 1 to 3 depth pixels per axis
+		ivec2 depthSize = textureSize(u_Depth, 0);
+		vec2 scale = vec2(depthSize) / vec2(size);
+		ivec2 first = ivec2(floor(vec2(texel) * scale));
+		ivec2 last = min(ivec2(ceil(vec2(texel + 1) * scale)) - 1, depthSize - 1);
+
+		for (int y = first.y; y <= last.y; y++)
+			for (int x = first.x; x <= last.x; x++)
+				depth = max(depth, texelFetch(u_Depth, ivec2(x, y), 0).r);
+	}
+	else
+	{
+		// keep the farthest depth so a texel only occludes what is behind everything it covers
+		ivec2 last = imageSize(u_Source) - 1;
+		ivec2 source = texel * 2;
+		depth = max(max(imageLoad(u_Source, min(source, last)).r, imageLoad(u_Source, min(source + ivec2(1, 0), last)).r),
+			max(imageLoad(u_Source, min(source + ivec2(0, 1), last)).r, imageLoad(u_Source, min(source + ivec2(1, 1), last)).r));
+	}
+
+	imageStore(u_Destination, texel, vec4(depth));
+}
@@ -13,6 +13,7 @@ layout(std140, binding = 1) uniform Matrices
 {
 	mat4 projection;
 	mat4 view;
+	mat4 viewProjection;
 };
 
 layout(std140, binding = 2) buffer Colors
@@ -20,6 +21,12 @@ layout(std140, binding = 2) buffer Colors
 	vec4 color[];
 };
 
+// written by cull.shader, maps gl_InstanceID to the instance when drawing indirectly
+layout(std430, binding = 4) readonly buffer visibleInstances
+{
+	uint visible[];
+};
+
 /*out VS_OUT
 {
 	vec3 color;
@@ -27,17 +34,33 @@ layout(std140, binding = 2) buffer Colors
 */
 
 uniform mat4 u_ModelMatrix;
+uniform bool u_UniformScale;
+uniform bool u_Culled;
+// instance drawn highlighted (picked in the editor), -1 for none
+uniform int u_Highlighted;
 
 out vec4 Color;
 out vec3 FragPos;
 out vec3 Normal;
+flat out float Highlight;
 
 void main()
 {
-	gl_Position = projection * view * model[gl_InstanceID] * vec4(position, 1.0);
-	FragPos = vec3(model[gl_InstanceID] * vec4(position, 1.0));
-	Normal = mat3(transpose(inverse(model[gl_InstanceID]))) * aNormal;
-	Color = color[gl_InstanceID];
+	uint id = u_Culled ? visible[gl_InstanceID] : uint(gl_InstanceID);
+	Highlight = int(id) == u_Highlighted ? 1.0 : 0.0;
+
+	mat4 instanceModel = model[id];
+	vec4 worldPos = instanceModel * vec4(position, 1.0);
+	gl_Position = viewProjection * worldPos;
+	FragPos = vec3(worldPos);
+
+	// for T*R*S the inverse transpose is R*S^-1 = mat3(model) * S^-2, the fragment shader renormalizes
+	mat3 linear = mat3(instanceModel);
+	if (u_UniformScale)
+		Normal = linear * aNormal;
+	else
+		Normal = linear * (aNormal / vec3(dot(linear[0], linear[0]), dot(linear[1], linear[1]), dot(linear[2], linear[2])));
+	Color = color[id];
 };
 
 #shader fragment
@@ -53,16 +76,19 @@ layout(location = 0) out vec4 out_color;
 in vec4 Color;
 in vec3 Normal;
 in vec3 FragPos;
+flat in float Highlight;
 
-uniform vec4 u_LightColor;
-uniform vec3 u_lightpos;
-uniform float u_PointLight_Constant;
-uniform float u_PointLight_Linear;
-uniform float u_PointLight_Quadratic;
-
-uniform vec3 u_viewpos;
-uniform float u_specularstrength;
-uniform float u_specularshininess;
+layout(std140, binding = 2) uniform LightingParams
+{
+	vec4 u_LightColor;
+	vec3 u_lightpos;
+	float u_PointLight_Constant;
+	vec3 u_viewpos;
+	float u_PointLight_Linear;
+	float u_PointLight_Quadratic;
+	float u_specularstrength;
+	float u_specularshininess;
+};
 
 void main()
 {
@@ -94,5 +120,6 @@ void main()
 
 
 	vec4 result = vec4(ambient + diffuse + specular, u_LightColor.a) * Color;
-	out_color = result;
+	// lit the same, tinted so it reads in the dark too
+	out_color = mix(result, vec4(1.0, 0.75, 0.1, result.a), 0.5 * Highlight);
 };
\ No newline at end of file
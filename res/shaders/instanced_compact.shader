@@ -0,0 +1,124 @@
+#shader vertex
+#version 460 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 aNormal;
+
+// CompactInstance, 7 uints per instance: position xyz, rotation, scale xy, scale z, color
+layout(std430, binding = 3) buffer compactInstances
+{
+	uint instanceData[];
+};
+
+layout(std140, binding = 1) uniform Matrices
+{
+	mat4 projection;
+	mat4 view;
+	mat4 viewProjection;
+};
+
+// written by cull.shader, maps gl_InstanceID to the instance when drawing indirectly
+layout(std430, binding = 4) readonly buffer visibleInstances
+{
+	uint visible[];
+};
+
+uniform bool u_Culled;
+// instance drawn highlighted (picked in the editor), -1 for none
+uniform int u_Highlighted;
+
+out vec4 Color;
+out vec3 FragPos;
+out vec3 Normal;
+flat out float Highlight;
+
+// smallest-three: the largest component was dropped and is rebuilt from the unit length
+vec4 DecodeQuaternion(uint bits)
+{
+	uint largest = bits >> 30;
+	vec3 small = (vec3((bits >> 20) & 1023u, (bits >> 10) & 1023u, bits & 1023u) / 1023.0 * 2.0 - 1.0) * 0.70710678;
+	float big = sqrt(max(1.0 - dot(small, small), 0.0));
+
+	if (largest == 0u) return vec4(big, small);
+	if (largest == 1u) return vec4(small.x, big, small.yz);
+	if (largest == 2u) return vec4(small.xy, big, small.z);
+	return vec4(small, big);
+}
+
+vec3 Rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+	uint id = u_Culled ? visible[gl_InstanceID] : uint(gl_InstanceID);
+	Highlight = int(id) == u_Highlighted ? 1.0 : 0.0;
+	uint base = id * 7u;
+
+	vec3 instancePos = uintBitsToFloat(uvec3(instanceData[base], instanceData[base + 1u], instanceData[base + 2u]));
+	vec4 rotation = DecodeQuaternion(instanceData[base + 3u]);
+	vec3 scale = vec3(unpackHalf2x16(instanceData[base + 4u]), unpackHalf2x16(instanceData[base + 5u]).x);
+
+	vec3 worldPos = Rotate(rotation, position * scale) + instancePos;
+
+	gl_Position = viewProjection * vec4(worldPos, 1.0);
+	FragPos = worldPos;
+	// inverse transpose of rotation * scale is rotation * inverse scale
+	Normal = Rotate(rotation, aNormal / scale);
+	Color = unpackUnorm4x8(instanceData[base + 6u]);
+};
+
+#shader fragment
+#version 460 core
+
+layout(location = 0) out vec4 out_color;
+
+in vec4 Color;
+in vec3 Normal;
+in vec3 FragPos;
+flat in float Highlight;
+
+layout(std140, binding = 2) uniform LightingParams
+{
+	vec4 u_LightColor;
+	vec3 u_lightpos;
+	float u_PointLight_Constant;
+	vec3 u_viewpos;
+	float u_PointLight_Linear;
+	float u_PointLight_Quadratic;
+	float u_specularstrength;
+	float u_specularshininess;
+};
+
+void main()
+{
+	vec3 LightColorNoAlpha = vec3(u_LightColor.r, u_LightColor.g, u_LightColor.b);
+
+	float ambientStrength = 0.1;
+	vec3 ambient = ambientStrength * LightColorNoAlpha;
+
+	vec3 norm = normalize(Normal);
+	vec3 lightDir = normalize(u_lightpos - FragPos);
+
+	float diff = max(dot(norm, lightDir), 0.0);
+	vec3 diffuse = diff * LightColorNoAlpha;
+
+	vec3 viewDir = normalize(u_viewpos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, norm);
+
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), u_specularshininess);
+	vec3 specular = u_specularstrength * spec * LightColorNoAlpha;
+
+	float distance = length(u_lightpos - FragPos);
+	float attenuation = 1.0 / (u_PointLight_Constant + u_PointLight_Linear * distance + u_PointLight_Quadratic * (distance * distance));
+
+	ambient *= attenuation * 10;
+	diffuse *= attenuation;
+	specular *= attenuation;
+
+
+	vec4 result = vec4(ambient + diffuse + specular, u_LightColor.a) * Color;
+	// lit the same, tinted so it reads in the dark too
+	out_color = mix(result, vec4(1.0, 0.75, 0.1, result.a), 0.5 * Highlight);
+};
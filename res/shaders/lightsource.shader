@@ -19,7 +19,17 @@ void main()
 layout(location = 0) out vec4 out_color;
 
 
-uniform vec4 u_LightColor;
+layout(std140, binding = 2) uniform LightingParams
+{
+	vec4 u_LightColor;
+	vec3 u_lightpos;
+	float u_PointLight_Constant;
+	vec3 u_viewpos;
+	float u_PointLight_Linear;
+	float u_PointLight_Quadratic;
+	float u_specularstrength;
+	float u_specularshininess;
+};
 
 void main()
 {
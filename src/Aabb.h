@@ -0,0 +1,98 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+
+#include "CpuFeatures.h"
+
+// Axis aligned box, empty (min > max) until something is grown into it
+struct Aabb
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	Aabb() = default;
+	Aabb(glm::vec3 min, glm::vec3 max) : min(min), max(max) {}
+
+	// box around a bounding sphere
+	static inline Aabb FromSphere(glm::vec3 center, float radius) { return Aabb(center - radius, center + radius); }
+
+	inline void Grow(glm::vec3 point) { min = glm::min(min, point); max = glm::max(max, point); }
+	inline void Grow(const Aabb& box) { min = glm::min(min, box.min); max = glm::max(max, box.max); }
+
+	inline bool IsEmpty() const { return min.x > max.x; }
+	inline glm::vec3 Extent() const { return max - min; }
+	// half the surface area, all the SAH needs
+	inline float HalfArea() const
+	{
+		if (IsEmpty())
+			return 0.0f;
+		glm::vec3 e = Extent();
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+
+	inline bool Overlaps(const Aabb& box) const
+	{
+		return min.x <= box.max.x && max.x >= box.min.x && min.y <= box.max.y && max.y >= box.min.y && min.z <= box.max.z && max.z >= box.min.z;
+	}
+	inline bool operator==(const Aabb& box) const { return min == box.min && max == box.max; }
+
+	// squared distance from point to the box, 0 inside
+	inline float DistanceSquared(glm::vec3 point) const
+	{
+		glm::vec3 d = glm::max(glm::max(min - point, point - max), glm::vec3(0.0f));
+		return glm::dot(d, d);
+	}
+
+	// slab test, entry distance along the ray or FLT_MAX on a miss. inverseDirection may hold infinities
+	inline float Intersect(glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance) const
+	{
+		glm::vec3 t0 = (min - origin) * inverseDirection;
+		glm::vec3 t1 = (max - origin) * inverseDirection;
+		glm::vec3 lower = glm::min(t0, t1), upper = glm::max(t0, t1);
+		float enter = std::max(std::max(lower.x, lower.y), std::max(lower.z, 0.0f));
+		float exit = std::min(std::min(upper.x, upper.y), std::min(upper.z, maxDistance));
+		return enter <= exit ? enter : FLT_MAX;
+	}
+};
+
+// A ray set up once for slab tests against many boxes (a BVH traversal). On x86 the three slabs are
+// tested at once in SSE lanes, the fourth lane repeats z
+struct RaySlabs
+{
+#ifdef SIMD_X86
+	__m128 origin, inverseDirection;
+
+	RaySlabs(glm::vec3 rayOrigin, glm::vec3 direction)
+	{
+		glm::vec3 inverse = 1.0f / direction;
+		origin = _mm_setr_ps(rayOrigin.x, rayOrigin.y, rayOrigin.z, rayOrigin.z);
+		inverseDirection = _mm_setr_ps(inverse.x, inverse.y, inverse.z, inverse.z);
+	}
+
+	// Aabb::Intersect
+	inline float Intersect(const Aabb& box, float maxDistance) const
+	{
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(box.min.x, box.min.y, box.min.z, box.min.z), origin), inverseDirection);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(box.max.x, box.max.y, box.max.z, box.max.z), origin), inverseDirection);
+		__m128 lower = _mm_min_ps(t0, t1), upper = _mm_max_ps(t0, t1);
+
+		// horizontal max of the entries and min of the exits
+		lower = _mm_max_ps(lower, _mm_shuffle_ps(lower, lower, _MM_SHUFFLE(1, 0, 3, 2)));
+		lower = _mm_max_ps(lower, _mm_shuffle_ps(lower, lower, _MM_SHUFFLE(2, 3, 0, 1)));
+		upper = _mm_min_ps(upper, _mm_shuffle_ps(upper, upper, _MM_SHUFFLE(1, 0, 3, 2)));
+		upper = _mm_min_ps(upper, _mm_shuffle_ps(upper, upper, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		float enter = std::max(_mm_cvtss_f32(lower), 0.0f);
+		float exit = std::min(_mm_cvtss_f32(upper), maxDistance);
+		return enter <= exit ? enter : FLT_MAX;
+	}
+#else
+	glm::vec3 origin, inverseDirection;
+
+	RaySlabs(glm::vec3 rayOrigin, glm::vec3 direction) : origin(rayOrigin), inverseDirection(1.0f / direction) {}
+
+	inline float Intersect(const Aabb& box, float maxDistance) const { return box.Intersect(origin, inverseDirection, maxDistance); }
+#endif
+};
@@ -0,0 +1,124 @@
+#include "AllocationTracker.h"
+#include "renderer.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<AllocationCheck> s_Check(AllocationCheck::Off);
+static std::atomic<bool> s_Tracking(false);
+static std::atomic<size_t> s_Count(0), s_Bytes(0);
+static size_t s_FrameCount = 0, s_FrameBytes = 0;
+
+void SetAllocationCheck(AllocationCheck check)
+{
+	s_Check.store(check);
+}
+
+AllocationCheck GetAllocationCheck()
+{
+	return s_Check.load();
+}
+
+void BeginTrackedFrame()
+{
+	s_Count.store(0, std::memory_order_relaxed);
+	s_Bytes.store(0, std::memory_order_relaxed);
+	s_Tracking.store(s_Check.load() != AllocationCheck::Off, std::memory_order_release);
+}
+
+void EndTrackedFrame()
+{
+	s_Tracking.store(false, std::memory_order_release);
+	s_FrameCount = s_Count.load(std::memory_order_relaxed);
+	s_FrameBytes = s_Bytes.load(std::memory_order_relaxed);
+}
+
+size_t GetFrameAllocationCount()
+{
+	return s_FrameCount;
+}
+
+size_t GetFrameAllocationBytes()
+{
+	return s_FrameBytes;
+}
+
+static void Track(size_t bytes)
+{
+	if (!s_Tracking.load(std::memory_order_relaxed))
+		return;
+
+	s_Count.fetch_add(1, std::memory_order_relaxed);
+	s_Bytes.fetch_add(bytes, std::memory_order_relaxed);
+	// the caller is on the stack right above
+	ASSERT(s_Check.load(std::memory_order_relaxed) != AllocationCheck::Assert);
+}
+
+static void* AllocateAligned(size_t bytes, size_t alignment)
+{
+#ifdef _MSC_VER
+	return _aligned_malloc(bytes, alignment);
+#else
+	// aligned_alloc wants a multiple of the alignment
+	return std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+#endif
+}
+
+static void FreeAligned(void* pointer)
+{
+#ifdef _MSC_VER
+	_aligned_free(pointer);
+#else
+	std::free(pointer);
+#endif
+}
+
+void* TrackedMalloc(size_t bytes, void*)
+{
+	Track(bytes);
+	return std::malloc(bytes);
+}
+
+void TrackedFree(void* pointer, void*)
+{
+	std::free(pointer);
+}
+
+// The scalar versions are all the rest (arrays, nothrow) end up in by default
+
+void* operator new(size_t bytes)
+{
+	Track(bytes);
+	if (void* pointer = std::malloc(bytes ? bytes : 1))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t bytes, std::align_val_t alignment)
+{
+	Track(bytes);
+	if (void* pointer = AllocateAligned(bytes ? bytes : 1, (size_t)alignment))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+	FreeAligned(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+	FreeAligned(pointer);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+
+// Counts heap allocations (global operator new) made while a frame is being tracked, from any thread, so
+// steady-state frames can be held to zero. The replaced operators are always linked in; outside a tracked
+// frame they cost one relaxed load.
+enum class AllocationCheck
+{
+	Off,
+	Report, // count, World Control shows the last frame
+	Assert // break into the debugger on the first one
+};
+
+void SetAllocationCheck(AllocationCheck check);
+AllocationCheck GetAllocationCheck();
+
+// Around the steady-state part of a frame, EndTrackedFrame makes its counts the last frame's
+void BeginTrackedFrame();
+void EndTrackedFrame();
+size_t GetFrameAllocationCount();
+size_t GetFrameAllocationBytes();
+
+// malloc and free counted like operator new, for libraries with their own allocator hooks (ImGui)
+void* TrackedMalloc(size_t bytes, void* userData);
+void TrackedFree(void* pointer, void* userData);
+
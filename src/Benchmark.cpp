@@ -0,0 +1,136 @@
+#include "Benchmark.h"
+#include "renderer.h"
+#include "Cubes.h"
+#include "TransformKernels.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <random>
+
+Benchmark::Benchmark(int frameCount) : m_FrameCount(frameCount), m_CurrentFrame(0), m_Timings(frameCount)
+{
+	GLCall(glGenQueries(QueryLatency * 2, &m_Queries[0][0]));
+}
+
+Benchmark::~Benchmark()
+{
+	GLCall(glDeleteQueries(QueryLatency * 2, &m_Queries[0][0]));
+}
+
+void Benchmark::BeginFrame()
+{
+	auto now = std::chrono::steady_clock::now();
+	if (m_CurrentFrame > 0)
+		m_Timings[m_CurrentFrame - 1].frameMs = std::chrono::duration<double, std::milli>(now - m_LastFrameStart).count();
+	m_FrameStart = m_LastFrameStart = now;
+
+	// query slot is about to be reused, so that frame's result has to come out first
+	if (m_CurrentFrame >= QueryLatency)
+		CollectGpuTime(m_CurrentFrame - QueryLatency);
+
+	GLCall(glQueryCounter(m_Queries[m_CurrentFrame % QueryLatency][0], GL_TIMESTAMP));
+}
+
+void Benchmark::EndFrame()
+{
+	GLCall(glQueryCounter(m_Queries[m_CurrentFrame % QueryLatency][1], GL_TIMESTAMP));
+
+	m_Timings[m_CurrentFrame].cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_FrameStart).count();
+	m_CurrentFrame++;
+}
+
+void Benchmark::CollectGpuTime(int frame)
+{
+	GLuint64 begin = 0, end = 0;
+	GLCall(glGetQueryObjectui64v(m_Queries[frame % QueryLatency][0], GL_QUERY_RESULT, &begin));
+	GLCall(glGetQueryObjectui64v(m_Queries[frame % QueryLatency][1], GL_QUERY_RESULT, &end));
+	m_Timings[frame].gpuMs = (end - begin) / 1000000.0;
+}
+
+void Benchmark::Report()
+{
+	// last frame never saw a following BeginFrame
+	if (m_CurrentFrame > 0)
+		m_Timings[m_CurrentFrame - 1].frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_LastFrameStart).count();
+
+	for (int i = std::max(0, m_CurrentFrame - QueryLatency); i < m_CurrentFrame; i++)
+		CollectGpuTime(i);
+
+	printf("frame,cpu_ms,gpu_ms,frame_ms\n");
+	for (int i = 0; i < m_CurrentFrame; i++)
+		printf("%d,%.4f,%.4f,%.4f\n", i, m_Timings[i].cpuMs, m_Timings[i].gpuMs, m_Timings[i].frameMs);
+
+	if (m_CurrentFrame == 0)
+		return;
+
+	auto summarize = [this](const char* label, double FrameTiming::* field)
+	{
+		std::vector<double> values(m_CurrentFrame);
+		double total = 0.0;
+		for (int i = 0; i < m_CurrentFrame; i++)
+		{
+			values[i] = m_Timings[i].*field;
+			total += values[i];
+		}
+		std::sort(values.begin(), values.end());
+
+		printf("%-6s avg %8.3f ms | min %8.3f | p50 %8.3f | p99 %8.3f | max %8.3f\n", label,
+			total / values.size(), values.front(), values[values.size() / 2], values[(values.size() * 99) / 100], values.back());
+	};
+
+	printf("\n%d frames\n", m_CurrentFrame);
+	summarize("cpu", &FrameTiming::cpuMs);
+	summarize("gpu", &FrameTiming::gpuMs);
+	summarize("frame", &FrameTiming::frameMs);
+}
+
+void RunTransformBenchmark(JobSystem& jobs, size_t count, unsigned int seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(0.0f, 100.0f), scale(0.5f, 3.0f), angle(-3.14159f, 3.14159f);
+
+	std::vector<glm::vec3> positions(count), scales(count), rotations(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		positions[i] = glm::vec3(position(random), position(random), position(random));
+		scales[i] = glm::vec3(scale(random), scale(random), scale(random));
+		rotations[i] = glm::vec3(angle(random), angle(random), angle(random));
+	}
+
+	std::vector<glm::mat4> reference(count), matrices(count);
+	for (size_t i = 0; i < count; i++)
+		reference[i] = Cubes::MakeMatrix(positions[i], scales[i], rotations[i]);
+
+	auto measure = [&](const char* label, auto build)
+	{
+		constexpr int Runs = 5;
+		double best = 0.0;
+		for (int run = 0; run < Runs; run++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			build();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best = run == 0 ? ms : std::min(best, ms);
+		}
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < count; i++)
+			for (int column = 0; column < 4; column++)
+				for (int row = 0; row < 4; row++)
+					maxError = std::max(maxError, std::abs(matrices[i][column][row] - reference[i][column][row]));
+
+		printf("%-22s %9.3f ms  %7.2f ns/matrix  max error %g\n", label, best, best * 1e6 / std::max<size_t>(count, 1), maxError);
+	};
+
+	printf("Transform rebuild, %zu matrices\n", count);
+	measure("Cubes::MakeMatrix", [&]
+	{
+		for (size_t i = 0; i < count; i++)
+			matrices[i] = Cubes::MakeMatrix(positions[i], scales[i], rotations[i]);
+	});
+	measure("closed form scalar", [&] { BuildMatricesScalar(positions.data(), scales.data(), rotations.data(), matrices.data(), count); });
+	measure(GetTransformKernelName(), [&] { GetTransformKernel()(positions.data(), scales.data(), rotations.data(), matrices.data(), count); });
+	measure("BuildMatrices (jobs)", [&] { BuildMatrices(jobs, positions.data(), scales.data(), rotations.data(), matrices.data(), count); });
+}
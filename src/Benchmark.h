@@ -0,0 +1,50 @@
+#pragma once
+#include <glad.h>
+
+#include <vector>
+#include <chrono>
+
+class JobSystem;
+
+// Fixed-frame benchmark: CPU time per frame from BeginFrame/EndFrame, GPU time from
+// GL_TIMESTAMP queries. Query results are read a few frames late so the CPU never waits on them.
+class Benchmark
+{
+private:
+	static constexpr int QueryLatency = 4;
+
+	struct FrameTiming
+	{
+		double cpuMs = 0.0;
+		double gpuMs = 0.0;
+		double frameMs = 0.0;
+	};
+
+	int m_FrameCount;
+	int m_CurrentFrame;
+
+	GLuint m_Queries[QueryLatency][2];
+	std::chrono::steady_clock::time_point m_FrameStart, m_LastFrameStart;
+
+	std::vector<FrameTiming> m_Timings;
+
+public:
+	Benchmark(int frameCount);
+	~Benchmark();
+
+	void BeginFrame();
+	void EndFrame();
+
+	inline bool IsFinished() const { return m_CurrentFrame >= m_FrameCount; }
+	inline int GetCurrentFrame() const { return m_CurrentFrame; }
+
+	// Reads outstanding GPU results, then prints every frame followed by a summary
+	void Report();
+
+private:
+	void CollectGpuTime(int frame);
+};
+
+// CPU only microbenchmark: rebuilds count model matrices with Cubes::MakeMatrix and with each
+// TransformKernels path (BuildMatrices on jobs), prints the best of a few runs and the largest difference to MakeMatrix
+void RunTransformBenchmark(JobSystem& jobs, size_t count, unsigned int seed);
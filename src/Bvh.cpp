@@ -0,0 +1,343 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <queue>
+
+Bvh::Bvh()
+	: m_Bounds(nullptr), m_NodeCount(0)
+{
+}
+
+void Bvh::Build(const BoundingSpheres& bounds, JobSystem& jobs)
+{
+	m_Bounds = &bounds;
+	m_NodeCount = 0;
+
+	uint32_t count = (uint32_t)bounds.Size();
+	if (count == 0)
+		return;
+
+	m_Items.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+		m_Items[i] = i;
+	m_LeafOf.resize(count);
+
+	// a binary tree over count leaves at most, children are always allocated after their parent
+	m_Nodes.resize(2 * (size_t)count - 1);
+	m_Parents.resize(m_Nodes.size());
+	m_Parents[0] = NoNode;
+	m_NodeCount = 1;
+
+	JobCounter counter;
+	Subdivide(0, 0, count, 0, jobs, counter);
+	jobs.Wait(counter);
+}
+
+void Bvh::Subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, int depth, JobSystem& jobs, JobCounter& counter)
+{
+	Aabb box, centers;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		box.Grow(ItemBox(m_Items[i]));
+		centers.Grow(ItemCenter(m_Items[i]));
+	}
+	m_Nodes[nodeIndex].box = box;
+
+	if (count <= MaxLeafSize)
+	{
+		MakeLeaf(nodeIndex, first, count);
+		return;
+	}
+
+	uint32_t* items = m_Items.data() + first;
+	glm::vec3 extent = centers.Extent();
+	uint32_t split = 0;
+
+	if (depth < MaxSahDepth)
+	{
+		// binned SAH: the centers are binned along each axis, every bin boundary is a candidate split
+		// costing area times items on both sides
+		float bestCost = FLT_MAX;
+		int bestAxis = -1, bestBin = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (extent[axis] <= 0.0f)
+				continue;
+
+			float origin = centers.min[axis], scale = Bins / extent[axis];
+			auto binOf = [&](uint32_t item) { return std::min(Bins - 1, (int)((ItemCenter(item)[axis] - origin) * scale)); };
+
+			Aabb binBoxes[Bins];
+			uint32_t binCounts[Bins] = {};
+			for (uint32_t i = 0; i < count; i++)
+			{
+				int bin = binOf(items[i]);
+				binCounts[bin]++;
+				binBoxes[bin].Grow(ItemBox(items[i]));
+			}
+
+			float leftArea[Bins - 1];
+			uint32_t leftCount[Bins - 1];
+			Aabb sweep;
+			uint32_t swept = 0;
+			for (int i = 0; i < Bins - 1; i++)
+			{
+				sweep.Grow(binBoxes[i]);
+				swept += binCounts[i];
+				leftArea[i] = sweep.HalfArea();
+				leftCount[i] = swept;
+			}
+
+			sweep = Aabb();
+			swept = 0;
+			for (int i = Bins - 1; i > 0; i--)
+			{
+				sweep.Grow(binBoxes[i]);
+				swept += binCounts[i];
+				float cost = leftArea[i - 1] * leftCount[i - 1] + sweep.HalfArea() * swept;
+				if (leftCount[i - 1] > 0 && swept > 0 && cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = i;
+				}
+			}
+		}
+
+		// small nodes stay leaves when no split beats testing every item
+		bool worthSplitting = bestAxis >= 0 && (count > MaxForcedLeafSize || bestCost < count * box.HalfArea());
+		if (worthSplitting)
+		{
+			float origin = centers.min[bestAxis], scale = Bins / extent[bestAxis];
+			uint32_t* middle = std::partition(items, items + count, [&](uint32_t item)
+			{
+				return std::min(Bins - 1, (int)((ItemCenter(item)[bestAxis] - origin) * scale)) < bestBin;
+			});
+			split = (uint32_t)(middle - items);
+		}
+		else if (bestAxis >= 0)
+		{
+			MakeLeaf(nodeIndex, first, count);
+			return;
+		}
+	}
+
+	// no SAH split (too deep, or every center in the same spot): halve at the median of the widest axis
+	if (split == 0)
+	{
+		if (count <= MaxForcedLeafSize)
+		{
+			MakeLeaf(nodeIndex, first, count);
+			return;
+		}
+
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		split = count / 2;
+		std::nth_element(items, items + split, items + count,
+			[&](uint32_t a, uint32_t b) { return ItemCenter(a)[axis] < ItemCenter(b)[axis]; });
+	}
+
+	uint32_t children = m_NodeCount.fetch_add(2);
+	m_Nodes[nodeIndex].first = children;
+	m_Nodes[nodeIndex].count = 0;
+	m_Parents[children] = nodeIndex;
+	m_Parents[children + 1] = nodeIndex;
+
+	// big subtrees build in parallel, the bottom of the tree isn't worth a job each
+	if (count >= ParallelBuildSize)
+		jobs.Run([this, children, first, split, depth, &jobs, &counter] { Subdivide(children, first, split, depth + 1, jobs, counter); }, &counter);
+	else
+		Subdivide(children, first, split, depth + 1, jobs, counter);
+	Subdivide(children + 1, first + split, count - split, depth + 1, jobs, counter);
+}
+
+void Bvh::MakeLeaf(uint32_t nodeIndex, uint32_t first, uint32_t count)
+{
+	m_Nodes[nodeIndex].first = first;
+	m_Nodes[nodeIndex].count = count;
+	for (uint32_t i = first; i < first + count; i++)
+		m_LeafOf[m_Items[i]] = nodeIndex;
+}
+
+Aabb Bvh::LeafBox(const Node& node) const
+{
+	Aabb box;
+	for (uint32_t i = node.first; i < node.first + node.count; i++)
+		box.Grow(ItemBox(m_Items[i]));
+	return box;
+}
+
+void Bvh::Refit(const DirtyRanges& moved)
+{
+	if (IsEmpty() || moved.Empty())
+		return;
+
+	uint32_t nodeCount = m_NodeCount.load();
+	if (moved.Count() * 8 > m_Items.size())
+	{
+		// most of the world moved, one sweep from the back refits children before their parents
+		for (uint32_t i = nodeCount; i-- > 0;)
+		{
+			Node& node = m_Nodes[i];
+			if (node.count > 0)
+				node.box = LeafBox(node);
+			else
+			{
+				node.box = m_Nodes[node.first].box;
+				node.box.Grow(m_Nodes[node.first + 1].box);
+			}
+		}
+		return;
+	}
+
+	// walk up from each moved instance's leaf until a box comes out the same
+	for (const DirtyRanges::Range& range : moved.GetRanges())
+	{
+		for (size_t index = range.begin; index < range.end; index++)
+		{
+			uint32_t node = m_LeafOf[index];
+			Aabb box = LeafBox(m_Nodes[node]);
+			while (!(box == m_Nodes[node].box))
+			{
+				m_Nodes[node].box = box;
+				node = m_Parents[node];
+				if (node == NoNode)
+					break;
+
+				box = m_Nodes[m_Nodes[node].first].box;
+				box.Grow(m_Nodes[m_Nodes[node].first + 1].box);
+			}
+		}
+	}
+}
+
+float Bvh::GetSahCost() const
+{
+	if (IsEmpty())
+		return 0.0f;
+
+	// traversal steps and item tests weighted by the chance a random ray through the root hits the node
+	float cost = 0.0f;
+	uint32_t nodeCount = m_NodeCount.load();
+	for (uint32_t i = 0; i < nodeCount; i++)
+		cost += m_Nodes[i].box.HalfArea() * (m_Nodes[i].count > 0 ? m_Nodes[i].count : 1);
+	float rootArea = m_Nodes[0].box.HalfArea();
+	return rootArea > 0.0f ? cost / rootArea : cost;
+}
+
+void Bvh::QueryBox(const Aabb& box, std::vector<uint32_t>& out) const
+{
+	if (IsEmpty())
+		return;
+
+	uint32_t stack[MaxDepth];
+	int size = 0;
+	stack[size++] = 0;
+	while (size > 0)
+	{
+		const Node& node = m_Nodes[stack[--size]];
+		if (!node.box.Overlaps(box))
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[size++] = node.first;
+			stack[size++] = node.first + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			uint32_t item = m_Items[i];
+			float radius = m_Bounds->radius[item];
+			if (box.DistanceSquared(ItemCenter(item)) <= radius * radius)
+				out.push_back(item);
+		}
+	}
+}
+
+void Bvh::QuerySphere(glm::vec3 center, float radius, std::vector<uint32_t>& out) const
+{
+	if (IsEmpty())
+		return;
+
+	uint32_t stack[MaxDepth];
+	int size = 0;
+	stack[size++] = 0;
+	while (size > 0)
+	{
+		const Node& node = m_Nodes[stack[--size]];
+		if (node.box.DistanceSquared(center) > radius * radius)
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[size++] = node.first;
+			stack[size++] = node.first + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			uint32_t item = m_Items[i];
+			glm::vec3 d = ItemCenter(item) - center;
+			float reach = radius + m_Bounds->radius[item];
+			if (glm::dot(d, d) <= reach * reach)
+				out.push_back(item);
+		}
+	}
+}
+
+void Bvh::Nearest(glm::vec3 point, size_t k, FrameArena& arena, std::vector<uint32_t>& out) const
+{
+	if (IsEmpty() || k == 0)
+		return;
+
+	// best first: nodes come off a min-heap by box distance, which bounds the center distance of
+	// everything in them, until the closest remaining node is farther than the kth best so far
+	typedef std::pair<float, uint32_t> Candidate;
+	// regrowing strands the old storage in the arena until Reset, so reserve what's likely needed
+	FrameVector<Candidate> nodeStorage(arena), bestStorage(arena);
+	nodeStorage.reserve(2 * MaxDepth);
+	bestStorage.reserve(k);
+	std::priority_queue<Candidate, FrameVector<Candidate>, std::greater<Candidate>> nodes(std::greater<Candidate>(), std::move(nodeStorage));
+	std::priority_queue<Candidate, FrameVector<Candidate>> best(std::less<Candidate>(), std::move(bestStorage)); // max-heap of the k closest items
+
+	nodes.push({ m_Nodes[0].box.DistanceSquared(point), 0 });
+	while (!nodes.empty())
+	{
+		Candidate candidate = nodes.top();
+		nodes.pop();
+		if (best.size() == k && candidate.first > best.top().first)
+			break;
+
+		const Node& node = m_Nodes[candidate.second];
+		if (node.count == 0)
+		{
+			nodes.push({ m_Nodes[node.first].box.DistanceSquared(point), node.first });
+			nodes.push({ m_Nodes[node.first + 1].box.DistanceSquared(point), node.first + 1 });
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			glm::vec3 d = ItemCenter(m_Items[i]) - point;
+			float distance = glm::dot(d, d);
+			if (best.size() < k)
+				best.push({ distance, m_Items[i] });
+			else if (distance < best.top().first)
+			{
+				best.pop();
+				best.push({ distance, m_Items[i] });
+			}
+		}
+	}
+
+	size_t begin = out.size();
+	out.resize(begin + best.size());
+	for (size_t i = out.size(); i-- > begin;)
+	{
+		out[i] = best.top().second;
+		best.pop();
+	}
+}
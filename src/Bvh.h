@@ -0,0 +1,156 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "Aabb.h"
+#include "DirtyRanges.h"
+#include "FrameArena.h"
+#include "InstanceStore.h"
+#include "JobSystem.h"
+
+// Bounding volume hierarchy over the instances' bounding spheres (as boxes, so rotation never changes
+// them). Built top-down with a binned surface area heuristic, subtrees over ParallelBuildSize instances
+// are built as jobs. Moves refit the boxes up from the moved instances' leaves without changing the
+// tree, adds and removes renumber the instances and need a Build.
+//
+// Items are dense InstanceStore indices. Queries visit O(log n) nodes for small regions, so they stay
+// cheap as the world grows.
+class Bvh
+{
+public:
+	// inner nodes have count 0 and their children at first, first + 1
+	struct Node
+	{
+		Aabb box;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	struct RayHit
+	{
+		uint32_t index = ~0u;
+		float distance = FLT_MAX;
+	};
+
+private:
+	static constexpr int Bins = 12;
+	static constexpr uint32_t MaxLeafSize = 4;
+	// leaves can get this big when the heuristic finds no split worth it, or every center is the same
+	static constexpr uint32_t MaxForcedLeafSize = 16;
+	static constexpr uint32_t ParallelBuildSize = 32 * 1024;
+	// past this depth nodes split at the median instead, so traversal stacks stay bounded
+	static constexpr int MaxSahDepth = 48;
+	static constexpr int MaxDepth = 128;
+	static constexpr uint32_t NoNode = ~0u;
+
+	const BoundingSpheres* m_Bounds;
+
+	std::vector<Node> m_Nodes;
+	std::vector<uint32_t> m_Parents;
+	std::vector<uint32_t> m_Items;
+	std::vector<uint32_t> m_LeafOf; // instance -> its leaf, for refits
+	std::atomic<uint32_t> m_NodeCount;
+
+public:
+	Bvh();
+
+	void Build(const BoundingSpheres& bounds, JobSystem& jobs);
+	// Instances in moved changed their bounds since the last build or refit
+	void Refit(const DirtyRanges& moved);
+
+	inline bool IsEmpty() const { return m_NodeCount.load() == 0; }
+	inline size_t GetNodeCount() const { return m_NodeCount.load(); }
+	inline const Aabb& GetBounds() const { return m_Nodes[0].box; }
+	// expected cost of a query relative to the root, lower is a tighter tree
+	float GetSahCost() const;
+
+	// Instances whose bounding sphere touches the box or sphere, appended to out
+	void QueryBox(const Aabb& box, std::vector<uint32_t>& out) const;
+	void QuerySphere(glm::vec3 center, float radius, std::vector<uint32_t>& out) const;
+	// The k instances with the closest centers to point, closest first. The search heaps live in arena
+	void Nearest(glm::vec3 point, size_t k, FrameArena& arena, std::vector<uint32_t>& out) const;
+
+	// Closest hit along the ray within maxDistance. Children are visited near to far, hitTest(index, origin,
+	// direction, maxDistance) does the exact test against an instance and returns the distance or FLT_MAX.
+	// direction doesn't need to be normalized, distances are in units of it
+	template<typename HitTest>
+	bool Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, const HitTest& hitTest, RayHit& hit) const;
+
+private:
+	inline Aabb ItemBox(uint32_t index) const
+	{
+		return Aabb::FromSphere(glm::vec3(m_Bounds->x[index], m_Bounds->y[index], m_Bounds->z[index]), m_Bounds->radius[index]);
+	}
+	inline glm::vec3 ItemCenter(uint32_t index) const { return glm::vec3(m_Bounds->x[index], m_Bounds->y[index], m_Bounds->z[index]); }
+
+	void Subdivide(uint32_t node, uint32_t first, uint32_t count, int depth, JobSystem& jobs, JobCounter& counter);
+	void MakeLeaf(uint32_t node, uint32_t first, uint32_t count);
+	Aabb LeafBox(const Node& node) const;
+};
+
+template<typename HitTest>
+bool Bvh::Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, const HitTest& hitTest, RayHit& hit) const
+{
+	hit = RayHit();
+	if (IsEmpty())
+		return false;
+
+	RaySlabs slabs(origin, direction);
+	hit.distance = maxDistance;
+	if (slabs.Intersect(m_Nodes[0].box, hit.distance) == FLT_MAX)
+		return false;
+
+	// entry distances ride along so nodes behind a closer hit found meanwhile are skipped
+	struct Entry
+	{
+		uint32_t node;
+		float distance;
+	};
+	Entry stack[MaxDepth];
+	int size = 0;
+	stack[size++] = { 0, 0.0f };
+
+	while (size > 0)
+	{
+		Entry entry = stack[--size];
+		if (entry.distance > hit.distance)
+			continue;
+
+		const Node& node = m_Nodes[entry.node];
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				float distance = hitTest(m_Items[i], origin, direction, hit.distance);
+				if (distance < hit.distance)
+				{
+					hit.distance = distance;
+					hit.index = m_Items[i];
+				}
+			}
+			continue;
+		}
+
+		float left = slabs.Intersect(m_Nodes[node.first].box, hit.distance);
+		float right = slabs.Intersect(m_Nodes[node.first + 1].box, hit.distance);
+		// the nearer child goes on top
+		if (left > right)
+		{
+			if (left != FLT_MAX) stack[size++] = { node.first, left };
+			if (right != FLT_MAX) stack[size++] = { node.first + 1, right };
+		}
+		else
+		{
+			if (right != FLT_MAX) stack[size++] = { node.first + 1, right };
+			if (left != FLT_MAX) stack[size++] = { node.first, left };
+		}
+	}
+
+	if (hit.index == ~0u)
+		hit.distance = FLT_MAX;
+	return hit.index != ~0u;
+}
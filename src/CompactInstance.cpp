@@ -0,0 +1,50 @@
+#include "CompactInstance.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/packing.hpp>
+
+#include <cmath>
+
+static uint32_t PackQuaternion(glm::quat q)
+{
+	float components[4] = { q.x, q.y, q.z, q.w };
+
+	int largest = 0;
+	for (int i = 1; i < 4; i++)
+		if (std::abs(components[i]) > std::abs(components[largest]))
+			largest = i;
+
+	// q and -q are the same rotation, keeping the dropped component positive lets the shader rebuild it with a sqrt
+	float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	uint32_t packed = (uint32_t)largest << 30;
+	int shift = 20;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+
+		// the three smaller components are within +-1/sqrt(2)
+		float normalized = glm::clamp(components[i] * sign * 0.70710678f + 0.5f, 0.0f, 1.0f);
+		packed |= (uint32_t)std::lround(normalized * 1023.0f) << shift;
+		shift -= 10;
+	}
+	return packed;
+}
+
+CompactInstance CompactInstance::Pack(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec4 color)
+{
+	glm::quat q = glm::angleAxis(rotation.x, glm::vec3(1.0f, 0.0f, 0.0f))
+		* glm::angleAxis(rotation.y, glm::vec3(0.0f, 1.0f, 0.0f))
+		* glm::angleAxis(rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+
+	CompactInstance instance;
+	instance.position[0] = position.x;
+	instance.position[1] = position.y;
+	instance.position[2] = position.z;
+	instance.rotation = PackQuaternion(glm::normalize(q));
+	instance.scaleXY = glm::packHalf2x16(glm::vec2(scale.x, scale.y));
+	instance.scaleZ = glm::packHalf2x16(glm::vec2(scale.z, 0.0f));
+	instance.color = glm::packUnorm4x8(color);
+	return instance;
+}
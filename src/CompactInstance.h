@@ -0,0 +1,20 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// 28 byte per-instance encoding, decoded back into a transform by instanced_compact.shader.
+// Full precision position, smallest-three quaternion, half float scale and RGBA8 color.
+struct CompactInstance
+{
+	float position[3];
+	uint32_t rotation; // index of the dropped component in the top 2 bits, the other three as 10 bit unorm
+	uint32_t scaleXY;  // packHalf2x16
+	uint32_t scaleZ;   // packHalf2x16, upper half unused
+	uint32_t color;    // packUnorm4x8
+
+	// rotation is Euler angles in radians, applied X then Y then Z like Cubes::MakeMatrix
+	static CompactInstance Pack(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec4 color);
+};
+
+static_assert(sizeof(CompactInstance) == 28, "instanced_compact.shader reads 7 uints per instance");
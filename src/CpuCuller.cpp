@@ -0,0 +1,268 @@
+#include "CpuCuller.h"
+#include "CpuFeatures.h"
+#include "renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+FrustumPlanes FrustumPlanes::FromViewProjection(const glm::mat4& viewProjection)
+{
+	// Gribb-Hartmann: left, right, bottom, top, near, far are row 3 +- rows 0..2
+	const glm::mat4 m = glm::transpose(viewProjection);
+	const glm::vec4 planes[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+
+	FrustumPlanes result;
+	for (int i = 0; i < 6; i++)
+	{
+		float length = glm::length(glm::vec3(planes[i]));
+		result.nx[i] = planes[i].x / length;
+		result.ny[i] = planes[i].y / length;
+		result.nz[i] = planes[i].z / length;
+		result.d[i] = planes[i].w / length;
+	}
+	return result;
+}
+
+static void CullScalar(const BoundingSpheres& spheres, size_t begin, size_t end, const FrustumPlanes& planes, std::vector<uint32_t>& visible)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+			inside = planes.nx[p] * spheres.x[i] + planes.ny[p] * spheres.y[i] + planes.nz[p] * spheres.z[i] + planes.d[p] >= -spheres.radius[i];
+
+		if (inside)
+			visible.push_back((uint32_t)i);
+	}
+}
+
+#ifdef SIMD_X86
+
+static void CullSSE(const BoundingSpheres& spheres, size_t begin, size_t end, const FrustumPlanes& planes, std::vector<uint32_t>& visible)
+{
+	__m128 nx[6], ny[6], nz[6], d[6];
+	for (int p = 0; p < 6; p++)
+	{
+		nx[p] = _mm_set1_ps(planes.nx[p]);
+		ny[p] = _mm_set1_ps(planes.ny[p]);
+		nz[p] = _mm_set1_ps(planes.nz[p]);
+		d[p] = _mm_set1_ps(planes.d[p]);
+	}
+
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&spheres.x[i]);
+		__m128 y = _mm_loadu_ps(&spheres.y[i]);
+		__m128 z = _mm_loadu_ps(&spheres.z[i]);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+
+		__m128 inside = _mm_cmpeq_ps(x, x); // all ones unless NaN
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(ny[p], y)), _mm_add_ps(_mm_mul_ps(nz[p], z), d[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+
+		for (int mask = _mm_movemask_ps(inside), lane = 0; mask; mask >>= 1, lane++)
+			if (mask & 1)
+				visible.push_back((uint32_t)(i + lane));
+	}
+
+	CullScalar(spheres, i, end, planes, visible);
+}
+
+TARGET_AVX2
+static void CullAVX2(const BoundingSpheres& spheres, size_t begin, size_t end, const FrustumPlanes& planes, std::vector<uint32_t>& visible)
+{
+	__m256 nx[6], ny[6], nz[6], d[6];
+	for (int p = 0; p < 6; p++)
+	{
+		nx[p] = _mm256_set1_ps(planes.nx[p]);
+		ny[p] = _mm256_set1_ps(planes.ny[p]);
+		nz[p] = _mm256_set1_ps(planes.nz[p]);
+		d[p] = _mm256_set1_ps(planes.d[p]);
+	}
+
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(&spheres.x[i]);
+		__m256 y = _mm256_loadu_ps(&spheres.y[i]);
+		__m256 z = _mm256_loadu_ps(&spheres.z[i]);
+		__m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+
+		__m256 inside = _mm256_cmp_ps(x, x, _CMP_EQ_OQ);
+		for (int p = 0; p < 6; p++)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], x), _mm256_mul_ps(ny[p], y)), _mm256_add_ps(_mm256_mul_ps(nz[p], z), d[p]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+		}
+
+		for (int mask = _mm256_movemask_ps(inside), lane = 0; mask; mask >>= 1, lane++)
+			if (mask & 1)
+				visible.push_back((uint32_t)(i + lane));
+	}
+
+	CullScalar(spheres, i, end, planes, visible);
+}
+
+#endif
+
+CpuCuller::CpuCuller(JobSystem& jobs, GLuint visibleBinding)
+	: m_Jobs(jobs), m_Kernel(CullScalar), m_KernelName("scalar"), m_Spheres(nullptr), m_Planes(), m_View(1.0f), m_Projection(1.0f), m_VisibleRing(GL_SHADER_STORAGE_BUFFER, visibleBinding, 64 * 1024), m_VisibleCount(0), m_OccludedCount(0), m_CullMs(0.0f)
+{
+#ifdef SIMD_X86
+	if (CpuHasAVX2())
+	{
+		m_Kernel = CullAVX2;
+		m_KernelName = "AVX2";
+	}
+	else
+	{
+		m_Kernel = CullSSE;
+		m_KernelName = "SSE";
+	}
+#endif
+}
+
+void CpuCuller::Cull(const InstanceStore& instances, const glm::mat4& view, const glm::mat4& projection, bool occlusion)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	m_Spheres = &instances.GetBounds();
+	m_View = view;
+	m_Projection = projection;
+	m_Planes = FrustumPlanes::FromViewProjection(projection * view);
+	// a slice per thread, the job system may have been resized since the last cull
+	m_SliceVisible.resize(m_Jobs.GetThreadCount());
+
+	RunSlices(&CpuCuller::CullSlice);
+
+	size_t count = 0;
+	for (const std::vector<uint32_t>& slice : m_SliceVisible)
+		count += slice.size();
+
+	m_Occluders.clear();
+	m_OccludedCount = 0;
+	if (occlusion)
+	{
+		SelectOccluders(instances);
+		if (!m_Occluders.empty())
+		{
+			RunSlices(&CpuCuller::RasterizeSlice);
+			RunSlices(&CpuCuller::OcclusionSlice);
+
+			size_t frustumVisible = count;
+			count = 0;
+			for (const std::vector<uint32_t>& slice : m_SliceVisible)
+				count += slice.size();
+			m_OccludedCount = frustumVisible - count;
+		}
+	}
+
+	GLsizeiptr bytes = std::max<size_t>(count, 1) * sizeof(GLuint);
+	if (bytes > m_VisibleRing.GetRegionSize())
+		m_VisibleRing.Resize(std::max(bytes, m_VisibleRing.GetRegionSize() * 2));
+
+	// slices are in index order, so the visible list stays sorted
+	GLuint* ids = (GLuint*)m_VisibleRing.BeginWrite();
+	if (ids)
+	{
+		for (const std::vector<uint32_t>& slice : m_SliceVisible)
+		{
+			memcpy(ids, slice.data(), slice.size() * sizeof(GLuint));
+			ids += slice.size();
+		}
+	}
+	m_VisibleRing.EndWrite();
+
+	m_VisibleCount = ids ? count : 0;
+	m_CullMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void CpuCuller::Draw(GLsizei vertexCount)
+{
+	GLCall(glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, (GLsizei)m_VisibleCount));
+	m_VisibleRing.Lock();
+}
+
+void CpuCuller::RunSlices(void (CpuCuller::*job)(int slice))
+{
+	m_Jobs.ParallelFor(0, m_SliceVisible.size(), 1, [this, job](size_t begin, size_t end)
+	{
+		for (size_t slice = begin; slice < end; slice++)
+			(this->*job)((int)slice);
+	});
+}
+
+void CpuCuller::CullSlice(int slice)
+{
+	// slices start on a multiple of 8 so only the very last one has a scalar tail
+	size_t count = m_Spheres->Size();
+	size_t sliceCount = m_SliceVisible.size();
+	size_t sliceSize = ((count + sliceCount - 1) / sliceCount + 7) & ~(size_t)7;
+	size_t begin = std::min(count, slice * sliceSize);
+	size_t end = std::min(count, begin + sliceSize);
+
+	std::vector<uint32_t>& visible = m_SliceVisible[slice];
+	visible.clear();
+	m_Kernel(*m_Spheres, begin, end, m_Planes, visible);
+}
+
+void CpuCuller::SelectOccluders(const InstanceStore& instances)
+{
+	// apparent size: radius over view depth, capped for whatever the camera is close to or inside of
+	const std::vector<uint8_t>& flags = instances.GetFlags();
+	m_OccluderCandidates.clear();
+	for (const std::vector<uint32_t>& slice : m_SliceVisible)
+	{
+		for (uint32_t id : slice)
+		{
+			if (!(flags[id] & InstanceFlag_Occluder))
+				continue;
+
+			float radius = m_Spheres->radius[id];
+			float depth = -(m_View[0][2] * m_Spheres->x[id] + m_View[1][2] * m_Spheres->y[id] + m_View[2][2] * m_Spheres->z[id] + m_View[3][2]);
+			m_OccluderCandidates.emplace_back(radius / std::max(depth, radius), id);
+		}
+	}
+
+	size_t count = std::min(m_OccluderCandidates.size(), MaxOccluders);
+	std::partial_sort(m_OccluderCandidates.begin(), m_OccluderCandidates.begin() + count, m_OccluderCandidates.end(),
+		[](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; });
+
+	glm::mat4 viewProjection = m_Projection * m_View;
+	for (size_t i = 0; i < count; i++)
+		m_Occluders.push_back(viewProjection * instances.GetMatrices()[m_OccluderCandidates[i].second]);
+}
+
+void CpuCuller::RasterizeSlice(int slice)
+{
+	// each slice owns a band of rows and rasterizes every occluder into it
+	int sliceCount = (int)m_SliceVisible.size();
+	int bandSize = (OcclusionBuffer::Height + sliceCount - 1) / sliceCount;
+	int firstRow = std::min(OcclusionBuffer::Height, slice * bandSize);
+	int lastRow = std::min(OcclusionBuffer::Height, firstRow + bandSize);
+	if (firstRow == lastRow)
+		return;
+
+	m_OcclusionBuffer.Clear(firstRow, lastRow);
+	for (const glm::mat4& occluder : m_Occluders)
+		m_OcclusionBuffer.RasterizeCube(occluder, firstRow, lastRow);
+}
+
+void CpuCuller::OcclusionSlice(int slice)
+{
+	// filters the slice's frustum visible ids in place, so the order is kept
+	std::vector<uint32_t>& visible = m_SliceVisible[slice];
+	size_t kept = 0;
+	for (uint32_t id : visible)
+	{
+		glm::vec3 center = glm::vec3(m_View * glm::vec4(m_Spheres->x[id], m_Spheres->y[id], m_Spheres->z[id], 1.0f));
+		if (!m_OcclusionBuffer.IsSphereOccluded(center, m_Spheres->radius[id], m_Projection))
+			visible[kept++] = id;
+	}
+	visible.resize(kept);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include "StreamBuffer.h"
+#include "InstanceStore.h"
+#include "OcclusionBuffer.h"
+#include "JobSystem.h"
+
+// Frustum planes as structure of arrays, normalized so distances are in world units
+struct FrustumPlanes
+{
+	float nx[6], ny[6], nz[6], d[6];
+
+	static FrustumPlanes FromViewProjection(const glm::mat4& viewProjection);
+};
+
+// Frustum culling on the CPU, for when compute shaders aren't an option. Bounding spheres are tested
+// 8 (AVX2) or 4 (SSE) at a time, split in slices over the job system, one per thread. The
+// visible ids go through a persistently mapped ring into the same binding GpuCuller writes, so the
+// instanced shaders read them the same way.
+//
+// With occlusion on, the closest looking frustum visible instances flagged InstanceFlag_Occluder (ground
+// plane, large cubes) are picked as occluders, rasterized into an OcclusionBuffer in row bands on the same threads, and the visible spheres
+// are tested against it before the ids are written.
+class CpuCuller
+{
+public:
+	typedef void (*Kernel)(const BoundingSpheres& spheres, size_t begin, size_t end, const FrustumPlanes& planes, std::vector<uint32_t>& visible);
+
+private:
+	static constexpr size_t MaxOccluders = 16;
+
+	JobSystem& m_Jobs;
+	Kernel m_Kernel;
+	const char* m_KernelName;
+
+	// per frame input, read by the workers while a cull is in flight
+	const BoundingSpheres* m_Spheres;
+	FrustumPlanes m_Planes;
+	glm::mat4 m_View, m_Projection;
+
+	std::vector<std::pair<float, uint32_t>> m_OccluderCandidates;
+	std::vector<glm::mat4> m_Occluders; // model view projection of the picked ones
+	OcclusionBuffer m_OcclusionBuffer;
+
+	// one output list per slice
+	std::vector<std::vector<uint32_t>> m_SliceVisible;
+
+	StreamBuffer m_VisibleRing;
+	size_t m_VisibleCount;
+	size_t m_OccludedCount;
+	float m_CullMs;
+
+public:
+	CpuCuller(JobSystem& jobs, GLuint visibleBinding);
+
+	CpuCuller(const CpuCuller&) = delete;
+	CpuCuller& operator=(const CpuCuller&) = delete;
+
+	// Culls, writes the visible ids into the ring and binds it
+	void Cull(const InstanceStore& instances, const glm::mat4& view, const glm::mat4& projection, bool occlusion);
+	// Draws the visible instances and fences the ring region
+	void Draw(GLsizei vertexCount);
+
+	inline size_t GetVisibleCount() const { return m_VisibleCount; }
+	inline size_t GetOccludedCount() const { return m_OccludedCount; }
+	inline size_t GetOccluderCount() const { return m_Occluders.size(); }
+	inline const OcclusionBuffer& GetOcclusionBuffer() const { return m_OcclusionBuffer; }
+	inline float GetCullMs() const { return m_CullMs; }
+	inline const char* GetKernelName() const { return m_KernelName; }
+
+private:
+	// runs job on every slice through the job system and waits for all of them
+	void RunSlices(void (CpuCuller::*job)(int slice));
+
+	void CullSlice(int slice);
+	void SelectOccluders(const InstanceStore& instances);
+	void RasterizeSlice(int slice);
+	void OcclusionSlice(int slice);
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// MSVC compiles AVX intrinsics without /arch, GCC and Clang need the function marked
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// Whether AVX2 kernels can run here, checked once
+bool CpuHasAVX2();
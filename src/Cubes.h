@@ -1,3 +1,4 @@
+#pragma once
 #include "common_includes.h"
 
 struct Cubes
@@ -22,10 +23,16 @@ struct Cubes
 
 	void calcMatrix()
 	{
-		modelMatrix = glm::translate(glm::mat4(1.0f), position);
+		modelMatrix = MakeMatrix(position, scale, rotation);
+	}
+
+	static glm::mat4 MakeMatrix(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation)
+	{
+		glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), position);
 		modelMatrix = glm::rotate(modelMatrix, rotation.x, glm::vec3(1.0, 0.0, 0.0));
 		modelMatrix = glm::rotate(modelMatrix, rotation.y, glm::vec3(0.0, 1.0, 0.0));
 		modelMatrix = glm::rotate(modelMatrix, rotation.z, glm::vec3(0.0, 0.0, 1.0));
 		modelMatrix = glm::scale(modelMatrix, scale);
+		return modelMatrix;
 	}
-};
\ No newline at end of file
+};
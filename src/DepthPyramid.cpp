@@ -0,0 +1,118 @@
+#include "DepthPyramid.h"
+#include "GLState.h"
+#include "renderer.h"
+
+#include <algorithm>
+#include <iostream>
+
+static int PreviousPowerOfTwo(int value)
+{
+	int result = 1;
+	while (result * 2 <= value)
+		result *= 2;
+	return result;
+}
+
+DepthPyramid::DepthPyramid(const std::string& shaderPath)
+	: m_ReduceShader(shaderPath), m_DepthUniform(m_ReduceShader.GetUniform<int>("u_Depth")), m_LevelUniform(m_ReduceShader.GetUniform<int>("u_Level")), m_DepthTexture(0), m_DepthFramebuffer(0), m_Width(0), m_Height(0),
+	  m_PyramidTexture(0), m_PyramidWidth(0), m_PyramidHeight(0), m_Levels(0)
+{
+}
+
+DepthPyramid::~DepthPyramid()
+{
+	Release();
+}
+
+void DepthPyramid::Build()
+{
+	// before Resize, which rebinds framebuffers
+	GLint sceneFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFramebuffer);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	Resize(viewport[2], viewport[3]);
+
+	// works the same for the window and an offscreen target, depth formats have to match (24/8)
+	GLCall(glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer));
+	GLCall(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_DepthFramebuffer));
+	GLCall(glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + m_Width, viewport[1] + m_Height, 0, 0, m_Width, m_Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST));
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer));
+
+	m_ReduceShader.Bind();
+	GLState::BindTexture(1, m_DepthTexture);
+	m_ReduceShader.SetUniform(m_DepthUniform, 1);
+
+	for (int level = 0; level < m_Levels; level++)
+	{
+		if (level > 0)
+		{
+			GLCall(glBindImageTexture(0, m_PyramidTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F));
+		}
+		GLCall(glBindImageTexture(1, m_PyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F));
+		m_ReduceShader.SetUniform(m_LevelUniform, level);
+
+		int width = std::max(m_PyramidWidth >> level, 1);
+		int height = std::max(m_PyramidHeight >> level, 1);
+		m_ReduceShader.Dispatch((width + 7) / 8, (height + 7) / 8);
+
+		GLCall(glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT));
+	}
+
+	GLCall(glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F));
+	GLCall(glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F));
+}
+
+void DepthPyramid::Bind(GLuint unit) const
+{
+	GLState::BindTexture(unit, m_PyramidTexture);
+}
+
+void DepthPyramid::Resize(int width, int height)
+{
+	if (width == m_Width && height == m_Height && m_PyramidTexture)
+		return;
+
+	Release();
+	m_Width = std::max(width, 1);
+	m_Height = std::max(height, 1);
+
+	GLCall(glGenTextures(1, &m_DepthTexture));
+	GLState::BindTexture(0, m_DepthTexture);
+	GLCall(glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, m_Width, m_Height));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+
+	GLCall(glGenFramebuffers(1, &m_DepthFramebuffer));
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, m_DepthFramebuffer));
+	GLCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_DepthTexture, 0));
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "(Warning) DepthPyramid depth copy " << m_Width << "x" << m_Height << " is incomplete" << std::endl;
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+	m_PyramidWidth = PreviousPowerOfTwo(m_Width);
+	m_PyramidHeight = PreviousPowerOfTwo(m_Height);
+	m_Levels = 1;
+	while ((std::max(m_PyramidWidth, m_PyramidHeight) >> m_Levels) > 0)
+		m_Levels++;
+
+	GLCall(glGenTextures(1, &m_PyramidTexture));
+	GLState::BindTexture(0, m_PyramidTexture);
+	GLCall(glTexStorage2D(GL_TEXTURE_2D, m_Levels, GL_R32F, m_PyramidWidth, m_PyramidHeight));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_Levels - 1));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+}
+
+void DepthPyramid::Release()
+{
+	// deleting 0 is a no-op
+	GLCall(glDeleteFramebuffers(1, &m_DepthFramebuffer));
+	GLState::DeleteTexture(m_DepthTexture);
+	GLState::DeleteTexture(m_PyramidTexture);
+
+	m_DepthFramebuffer = 0;
+	m_DepthTexture = 0;
+	m_PyramidTexture = 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <glad.h>
+
+#include <string>
+
+#include "Shader.h"
+
+// Max-depth mip chain of the scene for occlusion tests. Level 0 is the viewport rounded down to a
+// power of two, every level above keeps the farthest depth of the 2x2 texels below it.
+class DepthPyramid
+{
+private:
+	Shader m_ReduceShader;
+	Uniform<int> m_DepthUniform, m_LevelUniform;
+
+	// single sample copy of the scene depth, MSAA is resolved by the blit
+	GLuint m_DepthTexture;
+	GLuint m_DepthFramebuffer;
+	int m_Width, m_Height;
+
+	GLuint m_PyramidTexture;
+	int m_PyramidWidth, m_PyramidHeight, m_Levels;
+
+public:
+	DepthPyramid(const std::string& shaderPath);
+	~DepthPyramid();
+
+	DepthPyramid(const DepthPyramid&) = delete;
+	DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+	// Copies the depth of the bound draw framebuffer inside the viewport and rebuilds the levels
+	void Build();
+	void Bind(GLuint unit) const;
+
+	inline bool IsValid() const { return m_PyramidTexture != 0; }
+	inline int GetLevels() const { return m_Levels; }
+
+private:
+	void Resize(int width, int height);
+	void Release();
+};
@@ -0,0 +1,50 @@
+#include "DirtyRanges.h"
+
+#include <algorithm>
+
+void DirtyRanges::Add(size_t begin, size_t end)
+{
+	if (begin >= end)
+		return;
+
+	// appending past the last range is by far the common case (new cubes, sequential edits)
+	if (m_Ranges.empty() || begin > m_Ranges.back().end)
+	{
+		m_Ranges.push_back({ begin, end });
+		return;
+	}
+
+	// first range that ends at or after begin, ranges touching [begin, end) get merged into it
+	auto first = std::lower_bound(m_Ranges.begin(), m_Ranges.end(), begin,
+		[](const Range& range, size_t value) { return range.end < value; });
+
+	if (first == m_Ranges.end() || first->begin > end)
+	{
+		m_Ranges.insert(first, { begin, end });
+		return;
+	}
+
+	auto last = first;
+	while (last + 1 != m_Ranges.end() && (last + 1)->begin <= end)
+		last++;
+
+	first->begin = std::min(first->begin, begin);
+	first->end = std::max(last->end, end);
+	m_Ranges.erase(first + 1, last + 1);
+}
+
+void DirtyRanges::Truncate(size_t size)
+{
+	while (!m_Ranges.empty() && m_Ranges.back().begin >= size)
+		m_Ranges.pop_back();
+	if (!m_Ranges.empty())
+		m_Ranges.back().end = std::min(m_Ranges.back().end, size);
+}
+
+size_t DirtyRanges::Count() const
+{
+	size_t count = 0;
+	for (const Range& range : m_Ranges)
+		count += range.end - range.begin;
+	return count;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// Set of half-open [begin, end) index ranges, kept sorted with overlapping and touching ranges merged.
+class DirtyRanges
+{
+public:
+	struct Range
+	{
+		size_t begin;
+		size_t end;
+	};
+
+private:
+	std::vector<Range> m_Ranges;
+
+public:
+	void Add(size_t begin, size_t end);
+	inline void Add(size_t index) { Add(index, index + 1); }
+
+	inline void Clear() { m_Ranges.clear(); }
+	// becomes a copy of other, in the storage it already has
+	inline void Assign(const DirtyRanges& other) { m_Ranges.assign(other.m_Ranges.begin(), other.m_Ranges.end()); }
+	// drops everything at or past size, for when the indexed array shrinks
+	void Truncate(size_t size);
+	inline bool Empty() const { return m_Ranges.empty(); }
+
+	// number of indices covered by all ranges
+	size_t Count() const;
+
+	inline const std::vector<Range>& GetRanges() const { return m_Ranges; }
+};
@@ -0,0 +1,74 @@
+#include "FrameArena.h"
+#include "JobSystem.h"
+#include "renderer.h"
+
+#include <algorithm>
+#include <cstdint>
+
+FrameArena::FrameArena(int threadCount, size_t blockSize)
+	: m_BlockSize(blockSize), m_LastFrameBytes(0)
+{
+	SetThreadCount(threadCount);
+}
+
+void FrameArena::SetThreadCount(int count)
+{
+	count = std::max(count, 1);
+	size_t previous = m_Threads.size();
+	m_Threads.resize(count);
+	for (size_t i = previous; i < m_Threads.size(); i++)
+		m_Threads[i].blocks.push_back({ std::make_unique<std::byte[]>(m_BlockSize), m_BlockSize });
+}
+
+void* FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+	int thread = JobSystem::GetThreadIndex();
+	ASSERT(thread >= 0 && thread < (int)m_Threads.size());
+	SubArena& arena = m_Threads[thread];
+
+	Block* block = &arena.blocks.back();
+	uintptr_t base = (uintptr_t)block->memory.get();
+	size_t start = arena.offset;
+	size_t offset = ((base + start + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+	if (offset + bytes > block->size)
+	{
+		// overflow block for the rest of the frame, big enough for this allocation even if it's huge
+		size_t size = std::max(m_BlockSize, bytes + alignment);
+		arena.blocks.push_back({ std::make_unique<std::byte[]>(size), size });
+		block = &arena.blocks.back();
+		base = (uintptr_t)block->memory.get();
+		start = 0;
+		offset = ((base + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+	}
+
+	arena.used += offset + bytes - start;
+	arena.offset = offset + bytes;
+	return block->memory.get() + offset;
+}
+
+void FrameArena::Reset()
+{
+	m_LastFrameBytes = 0;
+	for (SubArena& arena : m_Threads)
+	{
+		m_LastFrameBytes += arena.used;
+		if (arena.blocks.size() > 1)
+		{
+			// the frame didn't fit, next time it does in one block (the slack covers alignment and frames growing)
+			size_t size = std::max(m_BlockSize, arena.used + arena.used / 2);
+			arena.blocks.clear();
+			arena.blocks.push_back({ std::make_unique<std::byte[]>(size), size });
+		}
+		arena.offset = 0;
+		arena.used = 0;
+	}
+}
+
+size_t FrameArena::GetCapacity() const
+{
+	size_t capacity = 0;
+	for (const SubArena& arena : m_Threads)
+		for (const Block& block : arena.blocks)
+			capacity += block.size;
+	return capacity;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator for data that only lives until the end of the frame. Every job system thread allocates
+// from its own sub-arena, so there's no locking, and Reset takes everything back at once. A sub-arena
+// that runs out chains extra blocks for the rest of the frame, Reset swaps them for one block as big as
+// the whole frame needed, so once the first frames are through the heap isn't touched.
+class FrameArena
+{
+private:
+	static constexpr size_t DefaultBlockSize = 64 * 1024;
+
+	struct Block
+	{
+		std::unique_ptr<std::byte[]> memory;
+		size_t size;
+	};
+
+	// a cache line each, threads bump their own offset
+	struct alignas(64) SubArena
+	{
+		std::vector<Block> blocks; // [0] is kept across frames, the rest overflowed this frame
+		size_t offset = 0; // into blocks.back()
+		size_t used = 0; // this frame, padding included
+	};
+
+	std::vector<SubArena> m_Threads;
+	size_t m_BlockSize;
+	size_t m_LastFrameBytes;
+
+public:
+	// One sub-arena per job system thread (JobSystem::GetThreadCount)
+	explicit FrameArena(int threadCount, size_t blockSize = DefaultBlockSize);
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// Along with JobSystem::SetWorkerCount, while no jobs run. Dropped sub-arenas take their memory with them
+	void SetThreadCount(int count);
+
+	// Valid until the next Reset. Only from job system threads, each gets its own sub-arena
+	void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+	template<typename T>
+	inline T* Allocate(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+	// End of frame, nothing may still point into the arena
+	void Reset();
+
+	// what the last frame allocated over all threads, and what is reserved for the next
+	inline size_t GetLastFrameBytes() const { return m_LastFrameBytes; }
+	size_t GetCapacity() const;
+};
+
+// Standard allocator over a FrameArena, for containers that are dropped with the frame. Freeing is a no-op,
+// a vector that grows leaves its old storage behind until Reset, so reserve what's known up front
+template<typename T>
+class FrameAllocator
+{
+	template<typename U>
+	friend class FrameAllocator;
+
+private:
+	FrameArena* m_Arena;
+
+public:
+	typedef T value_type;
+
+	FrameAllocator(FrameArena& arena) : m_Arena(&arena) {}
+	template<typename U>
+	FrameAllocator(const FrameAllocator<U>& other) : m_Arena(other.m_Arena) {}
+
+	inline T* allocate(size_t count) { return m_Arena->Allocate<T>(count); }
+	inline void deallocate(T*, size_t) {}
+
+	template<typename U>
+	inline bool operator==(const FrameAllocator<U>& other) const { return m_Arena == other.m_Arena; }
+};
+
+template<typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
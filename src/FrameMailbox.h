@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Triple buffer between one producer and one consumer thread. The producer fills GetBack() and publishes
+// it, the consumer swaps in whatever was published last. Neither side ever waits: a value the consumer
+// didn't get to in time is simply replaced, and the consumer keeps its current one until something newer
+// arrives. Slots are reused, so the producer has to rewrite everything it publishes.
+template<typename T>
+class FrameMailbox
+{
+private:
+	static constexpr uint8_t IndexMask = 3;
+	static constexpr uint8_t UnreadBit = 4;
+
+	T m_Slots[3];
+	// slot holding the latest published value, UnreadBit while the consumer hasn't swapped it in
+	std::atomic<uint8_t> m_Ready;
+	uint8_t m_Back; // producer side only
+	uint8_t m_Front; // consumer side only
+
+public:
+	FrameMailbox()
+		: m_Ready(1), m_Back(0), m_Front(2)
+	{
+	}
+
+	FrameMailbox(const FrameMailbox&) = delete;
+	FrameMailbox& operator=(const FrameMailbox&) = delete;
+
+	// Producer
+	inline T& GetBack() { return m_Slots[m_Back]; }
+	inline void Publish()
+	{
+		uint8_t previous = m_Ready.exchange(m_Back | UnreadBit, std::memory_order_acq_rel);
+		m_Back = previous & IndexMask;
+	}
+
+	// Consumer: swaps in the latest published value, false when there's nothing new
+	inline bool Acquire()
+	{
+		if (!(m_Ready.load(std::memory_order_relaxed) & UnreadBit))
+			return false;
+
+		uint8_t previous = m_Ready.exchange(m_Front, std::memory_order_acq_rel);
+		m_Front = previous & IndexMask;
+		return true;
+	}
+	inline const T& GetFront() const { return m_Slots[m_Front]; }
+};
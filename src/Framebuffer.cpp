@@ -0,0 +1,65 @@
+#include "Framebuffer.h"
+#include "renderer.h"
+
+#include <iostream>
+
+Framebuffer::Framebuffer(int width, int height, int samples) : m_RendererID(0), m_ColorAttachment(0), m_DepthAttachment(0), m_Width(width), m_Height(height), m_Samples(samples)
+{
+	Create();
+}
+
+Framebuffer::~Framebuffer()
+{
+	Release();
+}
+
+void Framebuffer::Resize(int width, int height)
+{
+	if (width == m_Width && height == m_Height)
+		return;
+
+	m_Width = width;
+	m_Height = height;
+	Release();
+	Create();
+}
+
+void Framebuffer::Bind() const
+{
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, m_RendererID));
+	GLCall(glViewport(0, 0, m_Width, m_Height));
+}
+
+void Framebuffer::Unbind() const
+{
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+void Framebuffer::Create()
+{
+	GLCall(glGenFramebuffers(1, &m_RendererID));
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, m_RendererID));
+
+	GLCall(glGenRenderbuffers(1, &m_ColorAttachment));
+	GLCall(glBindRenderbuffer(GL_RENDERBUFFER, m_ColorAttachment));
+	GLCall(glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_Samples, GL_RGBA8, m_Width, m_Height));
+	GLCall(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_ColorAttachment));
+
+	GLCall(glGenRenderbuffers(1, &m_DepthAttachment));
+	GLCall(glBindRenderbuffer(GL_RENDERBUFFER, m_DepthAttachment));
+	GLCall(glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_Samples, GL_DEPTH24_STENCIL8, m_Width, m_Height));
+	GLCall(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_DepthAttachment));
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "(Warning) Framebuffer " << m_Width << "x" << m_Height << " is incomplete" << std::endl;
+
+	GLCall(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+void Framebuffer::Release()
+{
+	GLCall(glDeleteRenderbuffers(1, &m_ColorAttachment));
+	GLCall(glDeleteRenderbuffers(1, &m_DepthAttachment));
+	GLCall(glDeleteFramebuffers(1, &m_RendererID));
+}
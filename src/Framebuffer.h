@@ -0,0 +1,29 @@
+#pragma once
+#include <glad.h>
+
+// Offscreen render target (color + depth renderbuffers), stands in for the
+// default framebuffer when there is no window.
+class Framebuffer
+{
+private:
+	GLuint m_RendererID;
+	GLuint m_ColorAttachment;
+	GLuint m_DepthAttachment;
+	int m_Width, m_Height, m_Samples;
+
+public:
+	Framebuffer(int width, int height, int samples = 0);
+	~Framebuffer();
+
+	void Resize(int width, int height);
+
+	void Bind() const;
+	void Unbind() const;
+
+	inline int GetWidth() const { return m_Width; }
+	inline int GetHeight() const { return m_Height; }
+
+private:
+	void Create();
+	void Release();
+};
@@ -0,0 +1,271 @@
+#include "GLState.h"
+#include "renderer.h"
+
+#include <iterator>
+
+static constexpr GLuint Unknown = ~0u;
+static constexpr GLuint TextureUnits = 16;
+
+// generic binding points that are cached, buffers bound to others always go through
+static const GLenum s_BufferTargets[] = {
+	GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER,
+	GL_DRAW_INDIRECT_BUFFER, GL_DISPATCH_INDIRECT_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+	GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER
+};
+static constexpr int ElementSlot = 1;
+
+static const GLenum s_Capabilities[] = {
+	GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_MULTISAMPLE, GL_SCISSOR_TEST, GL_STENCIL_TEST, GL_PRIMITIVE_RESTART
+};
+
+static struct
+{
+	GLuint program;
+	GLuint vertexArray;
+	GLuint buffers[std::size(s_BufferTargets)];
+	GLuint activeUnit;
+	GLuint textures[TextureUnits];
+	int capabilities[std::size(s_Capabilities)]; // -1 unknown
+	GLenum blendSource, blendDestination;
+	GLenum polygonMode;
+} s_State;
+
+static size_t s_Issued = 0, s_Elided = 0;
+static size_t s_LastIssued = 0, s_LastElided = 0;
+static size_t s_BindingSwitches = 0;
+
+static int BufferSlot(GLenum target)
+{
+	for (int i = 0; i < (int)std::size(s_BufferTargets); i++)
+		if (s_BufferTargets[i] == target)
+			return i;
+	return -1;
+}
+
+static int CapabilitySlot(GLenum capability)
+{
+	for (int i = 0; i < (int)std::size(s_Capabilities); i++)
+		if (s_Capabilities[i] == capability)
+			return i;
+	return -1;
+}
+
+// true when value changes, which then has to be issued
+static bool Change(GLuint& cached, GLuint value)
+{
+	if (cached == value)
+	{
+		s_Elided++;
+		return false;
+	}
+	cached = value;
+	s_Issued++;
+	return true;
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if (Change(s_State.program, program))
+	{
+		GLCall(glUseProgram(program));
+		s_BindingSwitches++;
+	}
+}
+
+void GLState::BindVertexArray(GLuint vertexArray)
+{
+	if (Change(s_State.vertexArray, vertexArray))
+	{
+		GLCall(glBindVertexArray(vertexArray));
+		s_State.buffers[ElementSlot] = Unknown;
+		s_BindingSwitches++;
+	}
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+	int slot = BufferSlot(target);
+	if (slot < 0)
+		s_Issued++;
+	else if (!Change(s_State.buffers[slot], buffer))
+		return;
+
+	GLCall(glBindBuffer(target, buffer));
+}
+
+void GLState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	GLCall(glBindBufferBase(target, index, buffer));
+	s_Issued++;
+	int slot = BufferSlot(target);
+	if (slot >= 0)
+		s_State.buffers[slot] = buffer;
+}
+
+void GLState::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	GLCall(glBindBufferRange(target, index, buffer, offset, size));
+	s_Issued++;
+	int slot = BufferSlot(target);
+	if (slot >= 0)
+		s_State.buffers[slot] = buffer;
+}
+
+void GLState::BindTexture(GLuint unit, GLuint texture)
+{
+	if (unit >= TextureUnits)
+	{
+		// not cached, and the active unit is left unknown
+		s_State.activeUnit = Unknown;
+		GLCall(glActiveTexture(GL_TEXTURE0 + unit));
+		GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+		s_Issued += 2;
+		s_BindingSwitches++;
+		return;
+	}
+
+	if (s_State.textures[unit] == texture)
+	{
+		s_Elided++;
+		return;
+	}
+
+	if (Change(s_State.activeUnit, unit))
+	{
+		GLCall(glActiveTexture(GL_TEXTURE0 + unit));
+	}
+	s_State.textures[unit] = texture;
+	s_Issued++;
+	s_BindingSwitches++;
+	GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+}
+
+void GLState::Enable(GLenum capability)
+{
+	int slot = CapabilitySlot(capability);
+	if (slot >= 0 && s_State.capabilities[slot] == 1)
+	{
+		s_Elided++;
+		return;
+	}
+
+	if (slot >= 0)
+		s_State.capabilities[slot] = 1;
+	s_Issued++;
+	GLCall(glEnable(capability));
+}
+
+void GLState::Disable(GLenum capability)
+{
+	int slot = CapabilitySlot(capability);
+	if (slot >= 0 && s_State.capabilities[slot] == 0)
+	{
+		s_Elided++;
+		return;
+	}
+
+	if (slot >= 0)
+		s_State.capabilities[slot] = 0;
+	s_Issued++;
+	GLCall(glDisable(capability));
+}
+
+void GLState::BlendFunc(GLenum source, GLenum destination)
+{
+	if (s_State.blendSource == source && s_State.blendDestination == destination)
+	{
+		s_Elided++;
+		return;
+	}
+
+	s_State.blendSource = source;
+	s_State.blendDestination = destination;
+	s_Issued++;
+	GLCall(glBlendFunc(source, destination));
+}
+
+void GLState::PolygonMode(GLenum mode)
+{
+	if (Change(s_State.polygonMode, mode))
+	{
+		GLCall(glPolygonMode(GL_FRONT_AND_BACK, mode));
+	}
+}
+
+void GLState::DeleteBuffer(GLuint buffer)
+{
+	if (!buffer)
+		return;
+
+	GLCall(glDeleteBuffers(1, &buffer));
+	for (GLuint& bound : s_State.buffers)
+		if (bound == buffer)
+			bound = 0;
+}
+
+void GLState::DeleteTexture(GLuint texture)
+{
+	if (!texture)
+		return;
+
+	GLCall(glDeleteTextures(1, &texture));
+	for (GLuint& bound : s_State.textures)
+		if (bound == texture)
+			bound = 0;
+}
+
+void GLState::DeleteVertexArray(GLuint vertexArray)
+{
+	if (!vertexArray)
+		return;
+
+	GLCall(glDeleteVertexArrays(1, &vertexArray));
+	if (s_State.vertexArray == vertexArray)
+	{
+		s_State.vertexArray = 0;
+		s_State.buffers[ElementSlot] = Unknown;
+	}
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+	// a program in use stays in use until another one is, its name with it
+	GLCall(glDeleteProgram(program));
+}
+
+void GLState::Invalidate()
+{
+	s_State.program = Unknown;
+	s_State.vertexArray = Unknown;
+	for (GLuint& buffer : s_State.buffers)
+		buffer = Unknown;
+	s_State.activeUnit = Unknown;
+	for (GLuint& texture : s_State.textures)
+		texture = Unknown;
+	for (int& capability : s_State.capabilities)
+		capability = -1;
+	s_State.blendSource = s_State.blendDestination = Unknown;
+	s_State.polygonMode = Unknown;
+}
+
+void GLState::EndFrame()
+{
+	s_LastIssued = s_Issued;
+	s_LastElided = s_Elided;
+	s_Issued = s_Elided = 0;
+}
+
+size_t GLState::GetIssuedCalls()
+{
+	return s_LastIssued;
+}
+
+size_t GLState::GetElidedCalls()
+{
+	return s_LastElided;
+}
+
+size_t GLState::GetBindingSwitches()
+{
+	return s_BindingSwitches;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <glad.h>
+
+#include <cstddef>
+
+// Shadow copy of the GL state the app binds and toggles: program, vertex array, buffer bindings per
+// target, 2D textures per unit, capabilities, blend function and polygon mode. Calls that wouldn't change
+// anything are skipped, both kinds are counted per frame. Everything that changes this state has to go
+// through here or put it back the way it was (ImGui's backend restores what it touches), otherwise call
+// Invalidate afterwards. The element array binding is vertex array state, it's forgotten on every switch.
+// Main (GL) thread only.
+class GLState
+{
+public:
+	static void UseProgram(GLuint program);
+	static void BindVertexArray(GLuint vertexArray);
+	static void BindBuffer(GLenum target, GLuint buffer);
+	// Always issued, they also change target's generic binding
+	static void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	static void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	// GL_TEXTURE_2D on texture unit unit, glActiveTexture only when the unit changes
+	static void BindTexture(GLuint unit, GLuint texture);
+	static void Enable(GLenum capability);
+	static void Disable(GLenum capability);
+	static void BlendFunc(GLenum source, GLenum destination);
+	// GL_FRONT_AND_BACK
+	static void PolygonMode(GLenum mode);
+
+	// Deleting an object unbinds it, these keep the cache in step (a reused name would look bound otherwise)
+	static void DeleteBuffer(GLuint buffer);
+	static void DeleteTexture(GLuint texture);
+	static void DeleteVertexArray(GLuint vertexArray);
+	static void DeleteProgram(GLuint program);
+
+	// Everything is issued again until it's known
+	static void Invalidate();
+
+	// Closes the frame's counts
+	static void EndFrame();
+	static size_t GetIssuedCalls(); // last frame
+	static size_t GetElidedCalls();
+	// program, vertex array and texture binds issued since startup, differences give the switches of a span
+	static size_t GetBindingSwitches();
+};
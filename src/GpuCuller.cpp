@@ -0,0 +1,116 @@
+#include "GpuCuller.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "GLState.h"
+#include "renderer.h"
+
+GpuCuller::GpuCuller(const std::string& cullShaderPath, const std::string& pyramidShaderPath, GLuint visibleBinding, GLuint commandBinding, GLuint rejectedBinding)
+	: m_CullShader(cullShaderPath), m_InstanceCountUniform(m_CullShader.GetUniform<unsigned int>("u_InstanceCount")),
+	  m_CompactUniform(m_CullShader.GetUniform<int>("u_Compact")), m_OcclusionUniform(m_CullShader.GetUniform<int>("u_Occlusion")),
+	  m_LateUniform(m_CullShader.GetUniform<int>("u_Late")), m_Pyramid(pyramidShaderPath), m_VisibleBinding(visibleBinding), m_CommandBinding(commandBinding), m_RejectedBinding(rejectedBinding),
+	  m_InstanceCount(0), m_Compact(false), m_Occlusion(false), m_StatsInstances(), m_StatsFrame(0)
+{
+	// allocated up front so the visible buffer is bound even before the first cull
+	m_VisibleBuffer.Resize(1);
+	m_LateVisibleBuffer.Resize(1);
+	m_RejectedBuffer.Resize(1);
+	m_CommandBuffer.Resize(1);
+	m_StatsBuffer.Resize(StatsLatency);
+	m_VisibleBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, m_VisibleBinding);
+
+	m_CullShader.Bind();
+	m_CullShader.SetUniform1i("u_Pyramid", PyramidUnit);
+	m_CullShader.Unbind();
+}
+
+void GpuCuller::Cull(size_t instanceCount, bool compact, GLuint vertexCount, bool occlusion)
+{
+	m_InstanceCount = instanceCount;
+	m_Compact = compact;
+	m_Occlusion = occlusion && m_Pyramid.IsValid();
+
+	size_t capacity = std::max<size_t>(instanceCount, 1);
+	m_VisibleBuffer.Resize(capacity);
+	m_LateVisibleBuffer.Resize(capacity);
+	m_RejectedBuffer.Resize(capacity);
+
+	CullCommands commands = {};
+	commands.early.vertexCount = vertexCount;
+	commands.late.vertexCount = vertexCount;
+	m_CommandBuffer.SetData(0, &commands, 1);
+
+	m_VisibleBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, m_VisibleBinding);
+	m_CommandBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, m_CommandBinding);
+	m_RejectedBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, m_RejectedBinding);
+	if (m_Occlusion)
+		m_Pyramid.Bind(PyramidUnit);
+
+	m_CullShader.Bind();
+	m_CullShader.SetUniform(m_InstanceCountUniform, (GLuint)instanceCount);
+	m_CullShader.SetUniform(m_CompactUniform, compact);
+	m_CullShader.SetUniform(m_OcclusionUniform, m_Occlusion);
+	m_CullShader.SetUniform(m_LateUniform, false);
+	m_CullShader.Dispatch((GLuint)((instanceCount + GroupSize - 1) / GroupSize));
+
+	// the vertex shader reads the visible ids, the draw reads the command
+	GLCall(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT));
+}
+
+void GpuCuller::Draw() const
+{
+	// stays bound, the late draw reads the same buffer
+	GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer.GetRendererID());
+	GLCall(glDrawArraysIndirect(GL_TRIANGLES, (const void*)offsetof(CullCommands, early)));
+}
+
+void GpuCuller::CullLate(bool retest)
+{
+	m_Pyramid.Build();
+
+	// nothing was rejected when the early phase had no pyramid yet
+	if (!retest || !m_Occlusion)
+		return;
+
+	m_LateVisibleBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, m_VisibleBinding);
+	m_Pyramid.Bind(PyramidUnit);
+
+	// the rejected count is only known on the GPU, threads past it return right away
+	m_CullShader.Bind();
+	m_CullShader.SetUniform(m_CompactUniform, m_Compact);
+	m_CullShader.SetUniform(m_OcclusionUniform, true);
+	m_CullShader.SetUniform(m_LateUniform, true);
+	m_CullShader.Dispatch((GLuint)((m_InstanceCount + GroupSize - 1) / GroupSize));
+
+	GLCall(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT));
+}
+
+void GpuCuller::DrawLate() const
+{
+	GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer.GetRendererID());
+	GLCall(glDrawArraysIndirect(GL_TRIANGLES, (const void*)offsetof(CullCommands, late)));
+}
+
+void GpuCuller::EndFrame()
+{
+	int slot = m_StatsFrame % StatsLatency;
+
+	// slot is about to be reused, so that frame's counters come out first
+	if (m_StatsFrame >= StatsLatency)
+	{
+		CullCommands commands;
+		m_StatsBuffer.GetData(slot, &commands, 1);
+
+		size_t instances = m_StatsInstances[slot];
+		m_Stats.instances = instances;
+		m_Stats.earlyDrawn = commands.early.instanceCount;
+		m_Stats.lateDrawn = commands.late.instanceCount;
+		m_Stats.occluded = commands.rejectedCount - commands.late.instanceCount;
+		m_Stats.frustumCulled = instances - commands.early.instanceCount - commands.rejectedCount;
+	}
+
+	m_StatsBuffer.CopyFrom(m_CommandBuffer.GetRendererID(), 0, slot, 1);
+	m_StatsInstances[slot] = m_InstanceCount;
+	m_StatsFrame++;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <glad.h>
+
+#include <string>
+
+#include "Shader.h"
+#include "GpuVector.h"
+#include "DepthPyramid.h"
+
+// Layout glDrawArraysIndirect reads
+struct DrawArraysIndirectCommand
+{
+	GLuint vertexCount;
+	GLuint instanceCount;
+	GLuint firstVertex;
+	GLuint baseInstance;
+};
+
+// drawCommands block in cull.shader
+struct CullCommands
+{
+	DrawArraysIndirectCommand early;
+	DrawArraysIndirectCommand late;
+	GLuint rejectedCount;
+	GLuint padding[3];
+};
+
+// Per frame counters, a few frames old
+struct CullStats
+{
+	size_t instances = 0;
+	size_t frustumCulled = 0;
+	size_t occluded = 0;
+	size_t earlyDrawn = 0;
+	size_t lateDrawn = 0;
+};
+
+// Culling on the GPU. A compute pass tests every instance's bounding sphere against the frustum
+// in the Matrices UBO, compacts the visible instance ids into a buffer and writes the instance count
+// of an indirect draw, so nothing is read back to the CPU.
+//
+// With occlusion on it runs in two phases. The early phase also tests against a depth pyramid of the
+// previous frame and draws what passes. The pyramid is then rebuilt from that depth and the late phase
+// re-tests only what the early phase rejected, so whatever the camera uncovered is drawn the same frame.
+class GpuCuller
+{
+private:
+	static constexpr int StatsLatency = 4;
+	static constexpr GLuint PyramidUnit = 1;
+
+	Shader m_CullShader;
+	Uniform<unsigned int> m_InstanceCountUniform;
+	Uniform<int> m_CompactUniform, m_OcclusionUniform, m_LateUniform;
+	DepthPyramid m_Pyramid;
+
+	GpuVector<GLuint> m_VisibleBuffer;
+	GpuVector<GLuint> m_LateVisibleBuffer;
+	GpuVector<GLuint> m_RejectedBuffer;
+	GpuVector<CullCommands> m_CommandBuffer;
+	GLuint m_VisibleBinding, m_CommandBinding, m_RejectedBinding;
+
+	size_t m_InstanceCount;
+	bool m_Compact;
+	bool m_Occlusion;
+
+	// counters are copied here every frame and read StatsLatency frames later, when the GPU is long done
+	GpuVector<CullCommands> m_StatsBuffer;
+	size_t m_StatsInstances[StatsLatency];
+	int m_StatsFrame;
+	CullStats m_Stats;
+
+public:
+	static constexpr GLuint GroupSize = 64; // local_size_x in cull.shader
+
+	GpuCuller(const std::string& cullShaderPath, const std::string& pyramidShaderPath, GLuint visibleBinding, GLuint commandBinding, GLuint rejectedBinding);
+
+	// Instance buffers have to be bound already (InstanceStore::Upload). Occlusion tests against the
+	// previous frame's pyramid, the first frame only frustum culls.
+	void Cull(size_t instanceCount, bool compact, GLuint vertexCount, bool occlusion);
+	// Draws the visible instances, vertex shaders map gl_InstanceID through the visible buffer
+	void Draw() const;
+
+	// After Draw when culling with occlusion: rebuilds the pyramid from the bound framebuffer's depth
+	// and, with retest, tests the rejected instances against it
+	void CullLate(bool retest);
+	void DrawLate() const;
+
+	// Queues this frame's counters for readback, after the last draw
+	void EndFrame();
+	inline const CullStats& GetStats() const { return m_Stats; }
+};
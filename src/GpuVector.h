@@ -0,0 +1,106 @@
+#pragma once
+#include <glad.h>
+
+#include <cstddef>
+#include <algorithm>
+
+#include "GLState.h"
+#include "renderer.h"
+
+// Typed GL buffer with vector-like growth. Storage is allocated on first use, grows geometrically,
+// and regrowing copies the old contents on the GPU (glCopyBufferSubData) instead of re-uploading them.
+template<typename T>
+class GpuVector
+{
+private:
+	GLuint m_RendererID = 0;
+	size_t m_Size = 0;
+	size_t m_Capacity = 0;
+
+public:
+	GpuVector() = default;
+	GpuVector(const GpuVector&) = delete;
+	GpuVector& operator=(const GpuVector&) = delete;
+
+	~GpuVector()
+	{
+		GLState::DeleteBuffer(m_RendererID);
+	}
+
+	// Elements past the old size are left undefined
+	void Resize(size_t size)
+	{
+		if (size > m_Capacity)
+			Reserve(std::max(size, m_Capacity * 2)); // double capacity
+		m_Size = size;
+	}
+
+	void Reserve(size_t capacity)
+	{
+		if (capacity > m_Capacity)
+			Reallocate(capacity);
+	}
+
+	void ShrinkToFit()
+	{
+		if (m_Capacity > m_Size)
+			Reallocate(m_Size);
+	}
+
+	void SetData(size_t first, const T* data, size_t count)
+	{
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, m_RendererID);
+		GLCall(glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof(T), count * sizeof(T), data));
+	}
+
+	// Blocks until the GPU has written the range
+	void GetData(size_t first, T* data, size_t count) const
+	{
+		GLState::BindBuffer(GL_COPY_READ_BUFFER, m_RendererID);
+		GLCall(glGetBufferSubData(GL_COPY_READ_BUFFER, first * sizeof(T), count * sizeof(T), data));
+	}
+
+	// GPU side copy from another buffer, e.g. a staging ring
+	void CopyFrom(GLuint source, GLintptr sourceOffset, size_t first, size_t count)
+	{
+		GLState::BindBuffer(GL_COPY_READ_BUFFER, source);
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, m_RendererID);
+		GLCall(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, first * sizeof(T), count * sizeof(T)));
+	}
+
+	void BindBase(GLenum target, GLuint binding) const
+	{
+		GLState::BindBufferBase(target, binding, m_RendererID);
+	}
+
+	inline GLuint GetRendererID() const { return m_RendererID; }
+	inline size_t GetSize() const { return m_Size; }
+	inline size_t GetCapacity() const { return m_Capacity; }
+	inline bool Empty() const { return m_Size == 0; }
+
+private:
+	void Reallocate(size_t capacity)
+	{
+		GLuint buffer = 0;
+		if (capacity > 0)
+		{
+			GLCall(glGenBuffers(1, &buffer));
+			GLState::BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			GLCall(glBufferStorage(GL_COPY_WRITE_BUFFER, capacity * sizeof(T), nullptr, GL_DYNAMIC_STORAGE_BIT));
+
+			size_t kept = std::min(m_Size, capacity);
+			if (m_RendererID && kept > 0)
+			{
+				GLState::BindBuffer(GL_COPY_READ_BUFFER, m_RendererID);
+				GLCall(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, kept * sizeof(T)));
+			}
+		}
+
+		// GL keeps the old storage alive until pending draws and the copy above are done with it
+		GLState::DeleteBuffer(m_RendererID);
+
+		m_RendererID = buffer;
+		m_Capacity = capacity;
+		m_Size = std::min(m_Size, capacity);
+	}
+};
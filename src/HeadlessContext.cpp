@@ -0,0 +1,165 @@
+#include "HeadlessContext.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#include <GLFW/glfw3.h>
+#else
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext() : m_Display(nullptr), m_Context(nullptr), m_Surface(nullptr)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	Destroy();
+}
+
+#ifdef _WIN32
+
+// No surfaceless path on WGL, so a hidden window stands in for it.
+bool HeadlessContext::Create(int major, int minor)
+{
+	if (!glfwInit())
+		return false;
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	GLFWwindow* window = glfwCreateWindow(1, 1, "headless", NULL, NULL);
+	if (!window)
+	{
+		std::cout << "(Headless) failed to create hidden window" << std::endl;
+		glfwTerminate();
+		return false;
+	}
+
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(0);
+	m_Context = window;
+	return true;
+}
+
+void HeadlessContext::Destroy()
+{
+	if (!m_Context)
+		return;
+
+	glfwDestroyWindow((GLFWwindow*)m_Context);
+	glfwTerminate();
+	m_Context = nullptr;
+}
+
+void* HeadlessContext::GetProcAddress(const char* name)
+{
+	return (void*)glfwGetProcAddress(name);
+}
+
+#else
+
+bool HeadlessContext::Create(int major, int minor)
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+	// Surfaceless platform needs no display server or GPU at all
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+
+	bool surfaceless = display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr);
+	if (!surfaceless)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+		{
+			std::cout << "(Headless) failed to initialize EGL" << std::endl;
+			return false;
+		}
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "(Headless) EGL has no desktop OpenGL support" << std::endl;
+		eglTerminate(display);
+		return false;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config = nullptr;
+	EGLint numConfigs = 0;
+	eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, major,
+		EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	// Surfaceless contexts don't need a config, pbuffer ones do
+	EGLContext context = eglCreateContext(display, numConfigs > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT)
+	{
+		std::cout << "(Headless) failed to create OpenGL " << major << "." << minor << " context (EGL error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+		std::cout << "           on Mesa try MESA_GL_VERSION_OVERRIDE=" << major << "." << minor << " MESA_GLSL_VERSION_OVERRIDE=" << major << minor << "0" << std::endl;
+		eglTerminate(display);
+		return false;
+	}
+
+	EGLSurface surface = EGL_NO_SURFACE;
+	if (!surfaceless && numConfigs > 0)
+	{
+		const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+	}
+
+	if (!eglMakeCurrent(display, surface, surface, context))
+	{
+		std::cout << "(Headless) failed to make context current" << std::endl;
+		if (surface != EGL_NO_SURFACE)
+			eglDestroySurface(display, surface);
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return false;
+	}
+
+	m_Display = display;
+	m_Context = context;
+	m_Surface = surface;
+	return true;
+}
+
+void HeadlessContext::Destroy()
+{
+	if (!m_Context)
+		return;
+
+	eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (m_Surface != EGL_NO_SURFACE)
+		eglDestroySurface(m_Display, m_Surface);
+	eglDestroyContext(m_Display, m_Context);
+	eglTerminate(m_Display);
+
+	m_Display = nullptr;
+	m_Context = nullptr;
+	m_Surface = nullptr;
+}
+
+void* HeadlessContext::GetProcAddress(const char* name)
+{
+	return (void*)eglGetProcAddress(name);
+}
+
+#endif
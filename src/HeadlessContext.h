@@ -0,0 +1,23 @@
+#pragma once
+#include <glad.h>
+
+// OpenGL context without a visible window, used by --headless runs.
+// Linux: EGL surfaceless (falls back to a 1x1 pbuffer), works on Mesa's llvmpipe without a display.
+// Windows: hidden GLFW window.
+class HeadlessContext
+{
+private:
+	void* m_Display;
+	void* m_Context;
+	void* m_Surface;
+
+public:
+	HeadlessContext();
+	~HeadlessContext();
+
+	bool Create(int major, int minor);
+	void Destroy();
+
+	// Loader for gladLoadGLLoader
+	static void* GetProcAddress(const char* name);
+};
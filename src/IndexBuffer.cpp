@@ -1,27 +1,26 @@
 #include "IndexBuffer.h"
+#include "GLState.h"
 #include "renderer.h"
 
 
 IndexBuffer::IndexBuffer(const GLuint* data, GLuint count) : m_Count(count)
 {
 	GLCall(glGenBuffers(1, &m_RendererID));
-	GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID));
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID);
 	GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, count*sizeof(GLuint), data, GL_STATIC_DRAW));
 }
 
 IndexBuffer::~IndexBuffer()
 {
-	GLCall(glDeleteBuffers(1, &m_RendererID));
+	GLState::DeleteBuffer(m_RendererID);
 }
 
 void IndexBuffer::Bind() const
 {
-	GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID));
-
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID);
 }
 
 void IndexBuffer::Unbind() const
 {
-	GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
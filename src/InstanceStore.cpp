@@ -0,0 +1,473 @@
+#include "InstanceStore.h"
+#include "Cubes.h"
+#include "TransformKernels.h"
+#include "MortonOrder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+static bool IsNonUniform(glm::vec3 scale)
+{
+	return scale.x != scale.y || scale.x != scale.z;
+}
+
+// corners of the unit cube are at +-0.5, same as in cull.shader
+static constexpr float CubeRadius = 0.8660254f;
+
+InstanceStore::InstanceStore(JobSystem& jobs, GLuint matrixBinding, GLuint colorsBinding, GLuint compactBinding)
+	: m_Jobs(jobs), m_FreeSlot(NoSlot), m_BatchBegin(NoSlot), m_NonUniformScaleCount(0), m_LayoutVersion(0), m_UnsortedCount(0), m_Format(InstanceFormat::Matrix), m_MatrixBinding(matrixBinding), m_ColorsBinding(colorsBinding), m_CompactBinding(compactBinding),
+	  m_Staging(GL_COPY_READ_BUFFER, 0, 64 * 1024)
+{
+}
+
+InstanceHandle InstanceStore::Add(const Cubes& cube, uint8_t flags)
+{
+	uint32_t index = (uint32_t)m_Matrices.size();
+	InstanceHandle handle = AllocateHandle(index);
+	m_Handles.push_back(handle);
+
+	m_Matrices.push_back(cube.modelMatrix);
+	m_Colors.push_back(cube.color);
+	m_Positions.push_back(cube.position);
+	m_Scales.push_back(cube.scale);
+	m_Rotations.push_back(cube.rotation);
+	m_Flags.push_back(flags);
+	m_NonUniformScaleCount += IsNonUniform(cube.scale);
+
+	m_Bounds.x.push_back(0.0f);
+	m_Bounds.y.push_back(0.0f);
+	m_Bounds.z.push_back(0.0f);
+	m_Bounds.radius.push_back(0.0f);
+	SetBounds(index, cube.position, cube.scale);
+
+	m_MatrixDirty.Add(index);
+	m_ColorsDirty.Add(index);
+	m_LayoutVersion++;
+	m_UnsortedCount++;
+	return handle;
+}
+
+InstanceBatch InstanceStore::BeginBatch(size_t count)
+{
+	size_t first = Size();
+	size_t end = first + count;
+	m_BatchBegin = (uint32_t)first;
+
+	m_Positions.resize(end);
+	m_Scales.resize(end);
+	m_Rotations.resize(end);
+	m_Colors.resize(end);
+
+	// the rest is derived in EndBatch, only sized here so Size() already counts the batch
+	m_Matrices.resize(end);
+	return { m_Positions.data() + first, m_Scales.data() + first, m_Rotations.data() + first, m_Colors.data() + first, count };
+}
+
+void InstanceStore::EndBatch(uint8_t flags, std::vector<InstanceHandle>& handles)
+{
+	size_t first = m_BatchBegin;
+	size_t end = Size();
+	size_t count = end - first;
+	m_BatchBegin = NoSlot;
+	if (count == 0)
+		return;
+
+	m_Flags.resize(end, flags);
+	m_Bounds.x.resize(end);
+	m_Bounds.y.resize(end);
+	m_Bounds.z.resize(end);
+	m_Bounds.radius.resize(end);
+	for (size_t i = first; i < end; i++)
+	{
+		m_NonUniformScaleCount += IsNonUniform(m_Scales[i]);
+		SetBounds((uint32_t)i, m_Positions[i], m_Scales[i]);
+	}
+	BuildMatrices(m_Jobs, &m_Positions[first], &m_Scales[first], &m_Rotations[first], &m_Matrices[first], count);
+
+	m_Handles.resize(end);
+	handles.reserve(handles.size() + count);
+	for (size_t i = first; i < end; i++)
+	{
+		m_Handles[i] = AllocateHandle((uint32_t)i);
+		handles.push_back(m_Handles[i]);
+	}
+
+	m_MatrixDirty.Add(first, end);
+	m_ColorsDirty.Add(first, end);
+	m_LayoutVersion++;
+	m_UnsortedCount += count;
+}
+
+// reuses the most recently freed handle first
+InstanceHandle InstanceStore::AllocateHandle(uint32_t index)
+{
+	if (m_FreeSlot == NoSlot)
+	{
+		m_Slots.push_back(index);
+		return (InstanceHandle)(m_Slots.size() - 1);
+	}
+
+	InstanceHandle handle = m_FreeSlot;
+	m_FreeSlot = m_Slots[handle];
+	m_Slots[handle] = index;
+	return handle;
+}
+
+template<typename T>
+static void MoveAndPop(std::vector<T>& data, uint32_t to)
+{
+	data[to] = data.back();
+	data.pop_back();
+}
+
+void InstanceStore::Remove(InstanceHandle handle)
+{
+	uint32_t index = m_Slots[handle];
+	uint32_t last = (uint32_t)Size() - 1;
+	m_NonUniformScaleCount -= IsNonUniform(m_Scales[index]);
+
+	// the last instance fills the hole so the streams stay dense, only its handle has to be patched
+	m_Handles[index] = m_Handles[last];
+	m_Slots[m_Handles[index]] = index;
+
+	MoveAndPop(m_Handles, index);
+	MoveAndPop(m_Matrices, index);
+	MoveAndPop(m_Colors, index);
+	MoveAndPop(m_Positions, index);
+	MoveAndPop(m_Scales, index);
+	MoveAndPop(m_Rotations, index);
+	MoveAndPop(m_Flags, index);
+	MoveAndPop(m_Bounds.x, index);
+	MoveAndPop(m_Bounds.y, index);
+	MoveAndPop(m_Bounds.z, index);
+	MoveAndPop(m_Bounds.radius, index);
+
+	m_MatrixDirty.Truncate(last);
+	m_ColorsDirty.Truncate(last);
+	m_MovedBounds.Truncate(last);
+	m_LayoutVersion++;
+	m_UnsortedCount++;
+	if (index != last)
+	{
+		m_MatrixDirty.Add(index);
+		m_ColorsDirty.Add(index);
+	}
+
+	m_Slots[handle] = m_FreeSlot;
+	m_FreeSlot = handle;
+}
+
+void InstanceStore::SetTransform(InstanceHandle handle, glm::vec3 position, glm::vec3 scale, glm::vec3 rotation)
+{
+	uint32_t index = m_Slots[handle];
+	m_NonUniformScaleCount += IsNonUniform(scale) - IsNonUniform(m_Scales[index]);
+	m_Positions[index] = position;
+	m_Scales[index] = scale;
+	m_Rotations[index] = rotation;
+	SetBounds(index, position, scale);
+	m_Matrices[index] = Cubes::MakeMatrix(position, scale, rotation);
+	m_MatrixDirty.Add(index);
+	m_MovedBounds.Add(index);
+}
+
+void InstanceStore::SetTransforms(size_t begin, size_t count, const glm::vec3* positions, const glm::vec3* scales, const glm::vec3* rotations)
+{
+	if (count == 0)
+		return;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t index = begin + i;
+		m_NonUniformScaleCount += IsNonUniform(scales[i]) - IsNonUniform(m_Scales[index]);
+		m_Positions[index] = positions[i];
+		m_Scales[index] = scales[i];
+		m_Rotations[index] = rotations[i];
+		SetBounds((uint32_t)index, positions[i], scales[i]);
+	}
+
+	BuildMatrices(m_Jobs, &m_Positions[begin], &m_Scales[begin], &m_Rotations[begin], &m_Matrices[begin], count);
+	m_MatrixDirty.Add(begin, begin + count);
+	m_MovedBounds.Add(begin, begin + count);
+}
+
+void InstanceStore::SetTransforms(const InstanceHandle* handles, const Transform* transforms, const glm::mat4* matrices, size_t count)
+{
+	std::atomic<ptrdiff_t> nonUniformChange(0);
+	m_Jobs.ParallelFor(0, count, ParallelPackBatch, [this, handles, transforms, matrices, &nonUniformChange](size_t begin, size_t end)
+	{
+		ptrdiff_t change = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			uint32_t index = m_Slots[handles[i]];
+			change += (ptrdiff_t)IsNonUniform(transforms[i].scale) - (ptrdiff_t)IsNonUniform(m_Scales[index]);
+			m_Positions[index] = transforms[i].position;
+			m_Scales[index] = transforms[i].scale;
+			m_Rotations[index] = transforms[i].rotation;
+			m_Matrices[index] = matrices[i];
+			SetBounds(index, transforms[i].position, transforms[i].scale);
+		}
+		nonUniformChange += change;
+	});
+	m_NonUniformScaleCount += nonUniformChange.load();
+
+	MarkScatteredDirty(handles, count, true);
+}
+
+void InstanceStore::SetRotations(const InstanceHandle* handles, const glm::vec3* rotations, const glm::mat4* matrices, size_t count)
+{
+	m_Jobs.ParallelFor(0, count, ParallelPackBatch, [this, handles, rotations, matrices](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			uint32_t index = m_Slots[handles[i]];
+			m_Rotations[index] = rotations[i];
+			m_Matrices[index] = matrices[i];
+		}
+	});
+
+	MarkScatteredDirty(handles, count, false);
+}
+
+void InstanceStore::MarkScatteredDirty(const InstanceHandle* handles, size_t count, bool moved)
+{
+	// past half the store one range beats tracking each index
+	if (count * 2 >= Size())
+	{
+		m_MatrixDirty.Add(0, Size());
+		if (moved)
+			m_MovedBounds.Add(0, Size());
+		return;
+	}
+
+	// sorted, every Add appends or extends the last range instead of inserting in the middle
+	m_ScatterScratch.resize(count);
+	for (size_t i = 0; i < count; i++)
+		m_ScatterScratch[i] = m_Slots[handles[i]];
+	std::sort(m_ScatterScratch.begin(), m_ScatterScratch.end());
+	for (uint32_t index : m_ScatterScratch)
+	{
+		m_MatrixDirty.Add(index);
+		if (moved)
+			m_MovedBounds.Add(index);
+	}
+}
+
+template<typename T>
+static void Permute(JobSystem& jobs, std::vector<T>& data, const std::vector<uint32_t>& order)
+{
+	std::vector<T> permuted(data.size());
+	jobs.ParallelFor(0, data.size(), 64 * 1024, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			permuted[i] = data[order[i]];
+	});
+	data.swap(permuted);
+}
+
+void InstanceStore::Reorder(const std::vector<uint32_t>& order)
+{
+	Permute(m_Jobs, m_Handles, order);
+	Permute(m_Jobs, m_Matrices, order);
+	Permute(m_Jobs, m_Colors, order);
+	Permute(m_Jobs, m_Positions, order);
+	Permute(m_Jobs, m_Scales, order);
+	Permute(m_Jobs, m_Rotations, order);
+	Permute(m_Jobs, m_Flags, order);
+	Permute(m_Jobs, m_Bounds.x, order);
+	Permute(m_Jobs, m_Bounds.y, order);
+	Permute(m_Jobs, m_Bounds.z, order);
+	Permute(m_Jobs, m_Bounds.radius, order);
+
+	for (size_t i = 0; i < m_Handles.size(); i++)
+		m_Slots[m_Handles[i]] = (uint32_t)i;
+
+	// every index may mean another instance now
+	m_MatrixDirty.Add(0, Size());
+	m_ColorsDirty.Add(0, Size());
+	m_MovedBounds.Clear();
+	m_LayoutVersion++;
+}
+
+void InstanceStore::SortSpatially()
+{
+	SortByMortonCode(m_Jobs, m_Bounds, m_SortOrder);
+	Reorder(m_SortOrder);
+	m_UnsortedCount = 0;
+}
+
+InstanceStore::Transform InstanceStore::GetTransform(InstanceHandle handle) const
+{
+	uint32_t index = m_Slots[handle];
+	return { m_Positions[index], m_Scales[index], m_Rotations[index] };
+}
+
+// rotation doesn't change a sphere around the cube's center
+void InstanceStore::SetBounds(uint32_t index, glm::vec3 position, glm::vec3 scale)
+{
+	glm::vec3 extent = glm::abs(scale);
+	m_Bounds.x[index] = position.x;
+	m_Bounds.y[index] = position.y;
+	m_Bounds.z[index] = position.z;
+	m_Bounds.radius[index] = CubeRadius * std::max(extent.x, std::max(extent.y, extent.z));
+}
+
+void InstanceStore::SetColor(InstanceHandle handle, glm::vec4 color)
+{
+	uint32_t index = m_Slots[handle];
+	m_Colors[index] = color;
+	m_ColorsDirty.Add(index);
+}
+
+void InstanceStore::SetFormat(InstanceFormat format)
+{
+	if (format == m_Format)
+		return;
+
+	// the other format's buffers went stale while unused
+	m_Format = format;
+	m_MatrixDirty.Add(0, Size());
+	m_ColorsDirty.Add(0, Size());
+}
+
+// Returns the number of bytes written
+template<typename T>
+size_t InstanceStore::UploadStream(GpuVector<T>& buffer, const std::vector<T>& data, DirtyRanges& dirty, GLubyte* staging, GLsizeiptr& stagingUsed)
+{
+	// grows geometrically, old contents are copied over on the GPU
+	buffer.Resize(data.size());
+
+	size_t written = 0;
+	for (const DirtyRanges::Range& range : dirty.GetRanges())
+	{
+		size_t count = range.end - range.begin;
+		GLsizeiptr bytes = count * sizeof(T);
+
+		if (staging && stagingUsed + bytes <= m_Staging.GetRegionSize())
+		{
+			memcpy(staging + stagingUsed, &data[range.begin], bytes);
+			buffer.CopyFrom(m_Staging.GetRendererID(), m_Staging.GetRegionOffset() + stagingUsed, range.begin, count);
+			stagingUsed += bytes;
+		}
+		else
+			buffer.SetData(range.begin, &data[range.begin], count);
+
+		written += bytes;
+	}
+	dirty.Clear();
+
+	return written;
+}
+
+// Packs straight into the staging ring, only the oversized path goes through a CPU side array
+size_t InstanceStore::UploadCompact(const DirtyRanges& dirty, GLubyte* staging, GLsizeiptr& stagingUsed)
+{
+	m_CompactBuffer.Resize(Size());
+
+	size_t written = 0;
+	for (const DirtyRanges::Range& range : dirty.GetRanges())
+	{
+		size_t count = range.end - range.begin;
+		GLsizeiptr bytes = count * sizeof(CompactInstance);
+
+		bool staged = staging && stagingUsed + bytes <= m_Staging.GetRegionSize();
+		CompactInstance* packed = staged ? (CompactInstance*)(staging + stagingUsed) : nullptr;
+		if (!staged)
+		{
+			m_CompactScratch.resize(count);
+			packed = m_CompactScratch.data();
+		}
+
+		size_t first = range.begin;
+		m_Jobs.ParallelFor(range.begin, range.end, ParallelPackBatch, [this, packed, first](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				packed[i - first] = CompactInstance::Pack(m_Positions[i], m_Scales[i], m_Rotations[i], m_Colors[i]);
+		});
+
+		if (staged)
+		{
+			m_CompactBuffer.CopyFrom(m_Staging.GetRendererID(), m_Staging.GetRegionOffset() + stagingUsed, range.begin, count);
+			stagingUsed += bytes;
+		}
+		else
+			m_CompactBuffer.SetData(range.begin, packed, count);
+
+		written += bytes;
+	}
+
+	return written;
+}
+
+size_t InstanceStore::Upload()
+{
+	// a compact instance carries both transform and color, so it's dirty when either is
+	if (m_Format == InstanceFormat::Compact)
+	{
+		m_CompactDirty.Assign(m_MatrixDirty);
+		for (const DirtyRanges::Range& range : m_ColorsDirty.GetRanges())
+			m_CompactDirty.Add(range.begin, range.end);
+	}
+
+	GLsizeiptr dirtyBytes = m_Format == InstanceFormat::Compact
+		? m_CompactDirty.Count() * sizeof(CompactInstance)
+		: m_MatrixDirty.Count() * sizeof(glm::mat4) + m_ColorsDirty.Count() * sizeof(glm::vec4);
+
+	size_t written = 0;
+	if (dirtyBytes > 0)
+	{
+		// steady state edits go through the fenced ring so the CPU never waits on the GPU,
+		// anything too big for it is a one-off burst the driver can take directly
+		if (dirtyBytes > m_Staging.GetRegionSize() && dirtyBytes <= MaxStagingRegionSize)
+			m_Staging.Resize(std::min(std::max(dirtyBytes, m_Staging.GetRegionSize() * 2), MaxStagingRegionSize));
+
+		GLubyte* staging = dirtyBytes <= m_Staging.GetRegionSize() ? (GLubyte*)m_Staging.BeginWrite() : nullptr;
+		GLsizeiptr stagingUsed = 0;
+
+		if (m_Format == InstanceFormat::Compact)
+		{
+			written += UploadCompact(m_CompactDirty, staging, stagingUsed);
+			m_MatrixDirty.Clear();
+			m_ColorsDirty.Clear();
+		}
+		else
+		{
+			written += UploadStream(m_MatrixBuffer, m_Matrices, m_MatrixDirty, staging, stagingUsed);
+			written += UploadStream(m_ColorsBuffer, m_Colors, m_ColorsDirty, staging, stagingUsed);
+		}
+
+		// fence the region behind the copies reading from it
+		if (staging)
+			m_Staging.Lock();
+	}
+
+	// buffers may have been reallocated by growth
+	if (m_Format == InstanceFormat::Compact)
+		m_CompactBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, m_CompactBinding);
+	else
+	{
+		m_MatrixBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, m_MatrixBinding);
+		m_ColorsBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, m_ColorsBinding);
+	}
+	return written;
+}
+
+void InstanceStore::ShrinkToFit()
+{
+	m_MatrixBuffer.ShrinkToFit();
+	m_ColorsBuffer.ShrinkToFit();
+	m_CompactBuffer.ShrinkToFit();
+	m_CompactScratch.clear();
+	m_CompactScratch.shrink_to_fit();
+}
+
+size_t InstanceStore::GetCapacity() const
+{
+	return m_Format == InstanceFormat::Compact ? m_CompactBuffer.GetCapacity() : m_MatrixBuffer.GetCapacity();
+}
+
+size_t InstanceStore::GetGpuBytes() const
+{
+	return m_MatrixBuffer.GetCapacity() * sizeof(glm::mat4) + m_ColorsBuffer.GetCapacity() * sizeof(glm::vec4)
+		+ m_CompactBuffer.GetCapacity() * sizeof(CompactInstance);
+}
@@ -0,0 +1,200 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include "StreamBuffer.h"
+#include "DirtyRanges.h"
+#include "GpuVector.h"
+#include "CompactInstance.h"
+#include "JobSystem.h"
+
+struct Cubes;
+
+// Stable across removals of other instances, the handle of a removed instance gets reused by a later Add
+typedef uint32_t InstanceHandle;
+
+// Per instance bits in InstanceStore::GetFlags
+enum InstanceFlag : uint8_t
+{
+	InstanceFlag_Occluder = 1 << 0 // big static geometry the software occlusion culler rasterizes
+};
+
+// What the instanced pass reads: full mat4 + vec4 color (80 B), or the 28 B CompactInstance
+enum class InstanceFormat
+{
+	Matrix,
+	Compact
+};
+
+// Bounding spheres as structure of arrays, indexed like the instances, for the SIMD culling kernels
+struct BoundingSpheres
+{
+	std::vector<float> x, y, z, radius;
+
+	inline size_t Size() const { return x.size(); }
+};
+
+// The new instances of InstanceStore::BeginBatch, written in place by the caller
+struct InstanceBatch
+{
+	glm::vec3* positions;
+	glm::vec3* scales;
+	glm::vec3* rotations;
+	glm::vec4* colors;
+	size_t count;
+};
+
+// Authoritative per-instance data for the instanced pass, stored as structure of arrays so every system
+// only streams the fields it reads: uploads the matrices and colors, culling the bounds and flags,
+// editing the position/scale/rotation. The arrays are dense, index i is the same instance in all of them
+// and in the GPU buffers; handles stay valid while other instances are added or removed.
+class InstanceStore
+{
+public:
+	struct Transform
+	{
+		glm::vec3 position;
+		glm::vec3 scale;
+		glm::vec3 rotation;
+	};
+
+private:
+	// staging regions grow up to this, bigger bursts (bulk spawns, first upload) go straight to the device buffers
+	static constexpr GLsizeiptr MaxStagingRegionSize = 8 * 1024 * 1024;
+
+	static constexpr uint32_t NoSlot = ~0u;
+
+	// compact packing of a dirty range and scattered updates are split into jobs of at least this many instances
+	static constexpr size_t ParallelPackBatch = 16 * 1024;
+
+	// Morton order goes stale once 1 / ResortFraction of the instances were added or removed since the last sort
+	static constexpr size_t ResortFraction = 8;
+
+	JobSystem& m_Jobs;
+
+	std::vector<glm::mat4> m_Matrices;
+	std::vector<glm::vec4> m_Colors;
+	std::vector<glm::vec3> m_Positions;
+	std::vector<glm::vec3> m_Scales;
+	std::vector<glm::vec3> m_Rotations;
+	std::vector<uint8_t> m_Flags;
+	BoundingSpheres m_Bounds;
+
+	// handle -> dense index, or the next free handle while the handle is unused. Removing moves the last
+	// instance into the hole, m_Handles (dense index -> handle) says whose slot to patch
+	std::vector<uint32_t> m_Slots;
+	std::vector<InstanceHandle> m_Handles;
+	uint32_t m_FreeSlot;
+
+	// first dense index of the open batch, NoSlot when there's none
+	uint32_t m_BatchBegin;
+
+	// while every instance scales uniformly the normal matrix is just the model matrix
+	size_t m_NonUniformScaleCount;
+
+	// indices changed since the last upload, tracked per stream since colors rarely change
+	DirtyRanges m_MatrixDirty;
+	DirtyRanges m_ColorsDirty;
+	// both merged for the compact format, kept so merging doesn't allocate every frame
+	DirtyRanges m_CompactDirty;
+
+	// for spatial indices: adds and removes renumber instances, moves only change bounds
+	uint64_t m_LayoutVersion;
+	DirtyRanges m_MovedBounds;
+
+	// adds and removes since the last SortSpatially, both leave instances out of Morton order
+	size_t m_UnsortedCount;
+	std::vector<uint32_t> m_SortOrder;
+
+	InstanceFormat m_Format;
+
+	// what the shader reads, sized to the scene. only the current format's buffers are kept up to date
+	GpuVector<glm::mat4> m_MatrixBuffer;
+	GpuVector<glm::vec4> m_ColorsBuffer;
+	GpuVector<CompactInstance> m_CompactBuffer;
+	GLuint m_MatrixBinding, m_ColorsBinding, m_CompactBinding;
+
+	// packed instances for uploads too big for the staging ring
+	std::vector<CompactInstance> m_CompactScratch;
+	// dense indices of scattered updates
+	std::vector<uint32_t> m_ScatterScratch;
+
+	// dirty spans are written here and copied into the device buffers on the GPU
+	StreamBuffer m_Staging;
+
+public:
+	InstanceStore(JobSystem& jobs, GLuint matrixBinding, GLuint colorsBinding, GLuint compactBinding);
+
+	InstanceHandle Add(const Cubes& cube, uint8_t flags = 0);
+	// Bulk add: BeginBatch grows every array once by count, the caller fills all of the batch's elements,
+	// then EndBatch derives bounds, builds the matrices with BuildMatrices and appends the new handles.
+	// The new instances are a single dirty range, so the next Upload sends them in one go
+	InstanceBatch BeginBatch(size_t count);
+	void EndBatch(uint8_t flags, std::vector<InstanceHandle>& handles);
+	void Remove(InstanceHandle handle);
+
+	void SetTransform(InstanceHandle handle, glm::vec3 position, glm::vec3 scale, glm::vec3 rotation);
+	// SetTransform for the dense range [begin, begin + count), matrices are rebuilt in one batch (BuildMatrices).
+	// The inputs may be the store's own arrays
+	void SetTransforms(size_t begin, size_t count, const glm::vec3* positions, const glm::vec3* scales, const glm::vec3* rotations);
+	// SetTransform for scattered instances whose matrices are already built, e.g. by a scene graph
+	void SetTransforms(const InstanceHandle* handles, const Transform* transforms, const glm::mat4* matrices, size_t count);
+	// New rotations with their already built matrices, e.g. from a simulation snapshot. Bounds don't change
+	void SetRotations(const InstanceHandle* handles, const glm::vec3* rotations, const glm::mat4* matrices, size_t count);
+	void SetColor(InstanceHandle handle, glm::vec4 color);
+	inline void SetFlags(InstanceHandle handle, uint8_t flags) { m_Flags[m_Slots[handle]] = flags; }
+
+	Transform GetTransform(InstanceHandle handle) const;
+	inline const glm::vec4& GetColor(InstanceHandle handle) const { return m_Colors[m_Slots[handle]]; }
+	inline uint8_t GetFlags(InstanceHandle handle) const { return m_Flags[m_Slots[handle]]; }
+	inline uint32_t GetIndex(InstanceHandle handle) const { return m_Slots[handle]; }
+	inline InstanceHandle GetHandle(uint32_t index) const { return m_Handles[index]; }
+
+	// dense streams, indexed like the GPU buffers and the culled instance ids
+	inline const std::vector<glm::mat4>& GetMatrices() const { return m_Matrices; }
+	inline const std::vector<glm::vec3>& GetPositions() const { return m_Positions; }
+	inline const std::vector<glm::vec3>& GetScales() const { return m_Scales; }
+	inline const std::vector<glm::vec3>& GetRotations() const { return m_Rotations; }
+	inline const std::vector<uint8_t>& GetFlags() const { return m_Flags; }
+	inline const BoundingSpheres& GetBounds() const { return m_Bounds; }
+	inline size_t Size() const { return m_Matrices.size(); }
+	inline bool HasUniformScale() const { return m_NonUniformScaleCount == 0; }
+
+	// Bumped by every add and remove, dense indices taken before are meaningless after
+	inline uint64_t GetLayoutVersion() const { return m_LayoutVersion; }
+	// Indices whose bounds changed since the last call, handed over and cleared
+	inline void TakeMovedBounds(DirtyRanges& moved) { moved.Clear(); std::swap(moved, m_MovedBounds); }
+
+	// Moves the instance at order[i] to index i in every stream. Handles follow their instances, the
+	// GPU buffers are uploaded again. Not while a batch is open
+	void Reorder(const std::vector<uint32_t>& order);
+	// Reorders along the Morton curve (SortByMortonCode) so instances close in space are close in memory
+	void SortSpatially();
+	// Spawns append at the end and removals move the last instance into the hole, enough of them and a
+	// SortSpatially pays off again
+	inline bool IsSpatialOrderStale() const { return m_UnsortedCount > 0 && m_UnsortedCount * ResortFraction >= Size(); }
+
+	void SetFormat(InstanceFormat format);
+	inline InstanceFormat GetFormat() const { return m_Format; }
+
+	// Sends dirty spans to the GPU and binds the buffers, returns the number of bytes written
+	size_t Upload();
+
+	// Drops spare GPU capacity left over from geometric growth
+	void ShrinkToFit();
+	size_t GetCapacity() const;
+	size_t GetGpuBytes() const;
+
+private:
+	template<typename T>
+	size_t UploadStream(GpuVector<T>& buffer, const std::vector<T>& data, DirtyRanges& dirty, GLubyte* staging, GLsizeiptr& stagingUsed);
+	InstanceHandle AllocateHandle(uint32_t index);
+	void SetBounds(uint32_t index, glm::vec3 position, glm::vec3 scale);
+	// the matrices (and bounds when moved) of handles' instances changed
+	void MarkScatteredDirty(const InstanceHandle* handles, size_t count, bool moved);
+	size_t UploadCompact(const DirtyRanges& dirty, GLubyte* staging, GLsizeiptr& stagingUsed);
+};
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Move-only void() callable for jobs. Captures up to InlineSize bytes live inside it, so queuing a job
+// doesn't touch the heap (std::function's inline buffer is only 16 bytes with libstdc++), bigger ones
+// are heap allocated.
+class JobFunction
+{
+public:
+	static constexpr size_t InlineSize = 56;
+
+private:
+	struct Ops
+	{
+		void (*invoke)(void* storage);
+		// move constructs into to and destroys from
+		void (*relocate)(void* from, void* to);
+		void (*destroy)(void* storage);
+	};
+
+	template<typename F>
+	struct InlineOps
+	{
+		static void Invoke(void* storage) { (*static_cast<F*>(storage))(); }
+		static void Relocate(void* from, void* to)
+		{
+			new (to) F(std::move(*static_cast<F*>(from)));
+			static_cast<F*>(from)->~F();
+		}
+		static void Destroy(void* storage) { static_cast<F*>(storage)->~F(); }
+		static constexpr Ops Table = { Invoke, Relocate, Destroy };
+	};
+
+	template<typename F>
+	struct HeapOps
+	{
+		static void Invoke(void* storage) { (**static_cast<F**>(storage))(); }
+		static void Relocate(void* from, void* to) { *static_cast<F**>(to) = *static_cast<F**>(from); }
+		static void Destroy(void* storage) { delete *static_cast<F**>(storage); }
+		static constexpr Ops Table = { Invoke, Relocate, Destroy };
+	};
+
+	alignas(std::max_align_t) unsigned char m_Storage[InlineSize];
+	const Ops* m_Ops;
+
+public:
+	JobFunction() : m_Ops(nullptr) {}
+	JobFunction(std::nullptr_t) : m_Ops(nullptr) {}
+
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, JobFunction>>>
+	JobFunction(F&& function)
+	{
+		typedef std::decay_t<F> Callable;
+		if constexpr (sizeof(Callable) <= InlineSize && alignof(Callable) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<Callable>)
+		{
+			new (m_Storage) Callable(std::forward<F>(function));
+			m_Ops = &InlineOps<Callable>::Table;
+		}
+		else
+		{
+			*reinterpret_cast<Callable**>(m_Storage) = new Callable(std::forward<F>(function));
+			m_Ops = &HeapOps<Callable>::Table;
+		}
+	}
+
+	JobFunction(JobFunction&& other) noexcept
+		: m_Ops(other.m_Ops)
+	{
+		if (m_Ops)
+			m_Ops->relocate(other.m_Storage, m_Storage);
+		other.m_Ops = nullptr;
+	}
+
+	JobFunction& operator=(JobFunction&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			m_Ops = other.m_Ops;
+			if (m_Ops)
+				m_Ops->relocate(other.m_Storage, m_Storage);
+			other.m_Ops = nullptr;
+		}
+		return *this;
+	}
+
+	JobFunction(const JobFunction&) = delete;
+	JobFunction& operator=(const JobFunction&) = delete;
+
+	~JobFunction() { Reset(); }
+
+	inline explicit operator bool() const { return m_Ops != nullptr; }
+	inline void operator()() { m_Ops->invoke(m_Storage); }
+
+	inline void Reset()
+	{
+		if (m_Ops)
+			m_Ops->destroy(m_Storage);
+		m_Ops = nullptr;
+	}
+};
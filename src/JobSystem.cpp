@@ -0,0 +1,293 @@
+#include "JobSystem.h"
+
+// index into m_Workers of the calling thread, -1 for threads the job system doesn't own
+static thread_local int t_WorkerIndex = -1;
+// jobs run from Wait inside a job are already inside the outer job's busy time
+static thread_local int t_JobDepth = 0;
+
+JobSystem::JobSystem(int workerCount)
+	: m_Queued(0), m_Quit(false), m_FrameStart(std::chrono::steady_clock::now())
+{
+	t_WorkerIndex = 0;
+	StartWorkers(workerCount);
+}
+
+JobSystem::~JobSystem()
+{
+	StopWorkers();
+}
+
+int JobSystem::GetThreadIndex()
+{
+	return t_WorkerIndex;
+}
+
+void JobSystem::SetWorkerCount(int count)
+{
+	if (count == GetWorkerCount())
+		return;
+
+	StopWorkers();
+	StartWorkers(count);
+}
+
+void JobSystem::StartWorkers(int count)
+{
+	count = std::max(count, 0);
+	m_Quit = false;
+
+	m_Workers.clear();
+	for (int i = 0; i <= count; i++)
+		m_Workers.push_back(std::make_unique<Worker>());
+	m_Utilization.assign(count + 1, 0.0f);
+
+	for (int i = 1; i <= count; i++)
+		m_Threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+void JobSystem::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Quit = true;
+	}
+	m_WorkReady.notify_all();
+
+	for (std::thread& thread : m_Threads)
+		thread.join();
+	m_Threads.clear();
+}
+
+void JobSystem::WorkerLoop(int index)
+{
+	t_WorkerIndex = index;
+
+	while (true)
+	{
+		if (RunOne())
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_WorkReady.wait(lock, [this] { return m_Quit || m_Queued.load() > 0; });
+		if (m_Quit)
+			return;
+	}
+}
+
+void JobSystem::Run(Function function, JobCounter* counter)
+{
+	Schedule(std::move(function), counter, false);
+}
+
+void JobSystem::RunOnMainThread(Function function, JobCounter* counter)
+{
+	Schedule(std::move(function), counter, true);
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, Function function, JobCounter* counter, bool mainThread)
+{
+	// counted right away, so waiting on counter also waits for the dependency
+	if (counter)
+		counter->m_Pending.fetch_add(1);
+
+	{
+		std::lock_guard<std::mutex> lock(dependency.m_Mutex);
+		if (!dependency.IsDone())
+		{
+			dependency.m_Continuations.push_back({ std::move(function), counter, mainThread });
+			return;
+		}
+	}
+
+	// already done, the count taken above goes to the scheduled job
+	if (counter)
+		counter->m_Pending.fetch_sub(1);
+	Schedule(std::move(function), counter, mainThread);
+}
+
+void JobSystem::Schedule(Function&& function, JobCounter* counter, bool mainThread)
+{
+	if (counter)
+		counter->m_Pending.fetch_add(1);
+
+	if (mainThread)
+	{
+		std::lock_guard<std::mutex> lock(m_MainMutex);
+		m_MainJobs.PushBack({ std::move(function), counter });
+		return;
+	}
+
+	// threads outside the system hand their jobs to the main thread's deque, where anyone can steal them
+	Push(std::max(t_WorkerIndex, 0), { std::move(function), counter });
+}
+
+void JobSystem::Push(int index, Job&& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Workers[index]->mutex);
+		m_Workers[index]->jobs.PushBack(std::move(job));
+	}
+	m_Queued.fetch_add(1);
+
+	// taking the lock orders this after any worker that's between checking m_Queued and sleeping
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+	}
+	m_WorkReady.notify_one();
+}
+
+bool JobSystem::Pop(int index, Job& job)
+{
+	Worker& worker = *m_Workers[index];
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	if (worker.jobs.Empty())
+		return false;
+
+	job = worker.jobs.PopBack();
+	m_Queued.fetch_sub(1);
+	return true;
+}
+
+bool JobSystem::Steal(int index, Job& job)
+{
+	// starting after our own index spreads the thieves over different victims
+	int count = (int)m_Workers.size();
+	for (int i = 1; i < count; i++)
+	{
+		Worker& victim = *m_Workers[(index + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.jobs.Empty())
+			continue;
+
+		job = victim.jobs.PopFront();
+		m_Queued.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+bool JobSystem::PopMainThread(Job& job)
+{
+	std::lock_guard<std::mutex> lock(m_MainMutex);
+	if (m_MainJobs.Empty())
+		return false;
+
+	job = m_MainJobs.PopFront();
+	return true;
+}
+
+bool JobSystem::RunOne()
+{
+	int index = t_WorkerIndex;
+	Job job;
+
+	bool found = (index == 0 && PopMainThread(job))
+		|| (index >= 0 && Pop(index, job))
+		|| Steal(std::max(index, 0), job);
+	if (!found)
+		return false;
+
+	Execute(job);
+	return true;
+}
+
+void JobSystem::Execute(Job& job)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	t_JobDepth++;
+	job.function();
+	t_JobDepth--;
+
+	if (t_JobDepth == 0 && t_WorkerIndex >= 0)
+	{
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		m_Workers[t_WorkerIndex]->busyNs.fetch_add((uint64_t)ns, std::memory_order_relaxed);
+	}
+
+	Finish(job.counter);
+}
+
+void JobSystem::Finish(JobCounter* counter)
+{
+	if (!counter)
+		return;
+
+	// the counter may be gone as soon as the lock is released, Wait takes it before returning
+	std::vector<JobCounter::Continuation> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->m_Mutex);
+		if (counter->m_Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			ready.swap(counter->m_Continuations);
+	}
+
+	// each continuation was counted in RunAfter, Schedule counts it again
+	for (JobCounter::Continuation& continuation : ready)
+	{
+		Schedule(std::move(continuation.function), continuation.counter, continuation.mainThread);
+		if (continuation.counter)
+			Finish(continuation.counter);
+	}
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (!counter.IsDone())
+	{
+		if (!RunOne())
+			std::this_thread::yield();
+	}
+
+	// the last Finish may still hold the lock
+	std::lock_guard<std::mutex> lock(counter.m_Mutex);
+}
+
+void JobSystem::RunMainThreadJobs()
+{
+	Job job;
+	while (PopMainThread(job))
+		Execute(job);
+}
+
+void JobSystem::EndFrame()
+{
+	auto now = std::chrono::steady_clock::now();
+	double frameNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_FrameStart).count();
+	m_FrameStart = now;
+
+	for (size_t i = 0; i < m_Workers.size(); i++)
+	{
+		uint64_t busy = m_Workers[i]->busyNs.exchange(0, std::memory_order_relaxed);
+		m_Utilization[i] = frameNs > 0.0 ? (float)std::min(busy / frameNs, 1.0) : 0.0f;
+	}
+}
+
+void JobSystem::JobQueue::PushBack(Job&& job)
+{
+	if (m_Count == m_Slots.size())
+	{
+		// unrolled into the front of a ring twice the size
+		std::vector<Job> slots(std::max<size_t>(m_Slots.size() * 2, 64));
+		for (size_t i = 0; i < m_Count; i++)
+			slots[i] = std::move(m_Slots[(m_Head + i) % m_Slots.size()]);
+		m_Slots.swap(slots);
+		m_Head = 0;
+	}
+
+	m_Slots[(m_Head + m_Count) % m_Slots.size()] = std::move(job);
+	m_Count++;
+}
+
+JobSystem::Job JobSystem::JobQueue::PopBack()
+{
+	m_Count--;
+	return std::move(m_Slots[(m_Head + m_Count) % m_Slots.size()]);
+}
+
+JobSystem::Job JobSystem::JobQueue::PopFront()
+{
+	Job job = std::move(m_Slots[m_Head]);
+	m_Head = (m_Head + 1) % m_Slots.size();
+	m_Count--;
+	return job;
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "JobFunction.h"
+
+// Outstanding jobs of a group. Jobs started with a counter hold it up until they finish,
+// JobSystem::Wait joins them and JobSystem::RunAfter queues work behind them.
+class JobCounter
+{
+	friend class JobSystem;
+
+private:
+	struct Continuation
+	{
+		JobFunction function;
+		JobCounter* counter;
+		bool mainThread;
+	};
+
+	std::atomic<int> m_Pending{ 0 };
+	// guards the continuations against the last job finishing while one is added
+	std::mutex m_Mutex;
+	std::vector<Continuation> m_Continuations;
+
+public:
+	inline bool IsDone() const { return m_Pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Work-stealing scheduler for per-frame work. Every thread, the main thread included, owns a deque:
+// it pushes and pops its own jobs at the back, idle threads steal the oldest (biggest, for ParallelFor's
+// halving) from the front of the others. Waiting runs jobs instead of blocking, so the main thread
+// helps with whatever it waits on. Jobs that make GL calls go through RunOnMainThread, only the
+// main thread runs those, from Wait and RunMainThreadJobs.
+class JobSystem
+{
+public:
+	typedef JobFunction Function;
+
+private:
+	struct Job
+	{
+		Function function;
+		JobCounter* counter = nullptr;
+	};
+
+	// Deque over a ring buffer that only ever grows, so once it has held a frame's worth of jobs queuing
+	// doesn't allocate (std::deque allocates and frees its blocks as it goes)
+	class JobQueue
+	{
+	private:
+		std::vector<Job> m_Slots;
+		size_t m_Head = 0;
+		size_t m_Count = 0;
+
+	public:
+		inline bool Empty() const { return m_Count == 0; }
+		void PushBack(Job&& job);
+		Job PopBack();
+		Job PopFront();
+	};
+
+	struct Worker
+	{
+		std::mutex mutex;
+		JobQueue jobs;
+		std::atomic<uint64_t> busyNs{ 0 };
+	};
+
+	// [0] is the main thread, [i] the thread m_Threads[i - 1]
+	std::vector<std::unique_ptr<Worker>> m_Workers;
+	std::vector<std::thread> m_Threads;
+
+	std::mutex m_MainMutex;
+	JobQueue m_MainJobs;
+
+	// idle workers sleep until something is queued
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WorkReady;
+	std::atomic<int> m_Queued;
+	bool m_Quit;
+
+	std::chrono::steady_clock::time_point m_FrameStart;
+	std::vector<float> m_Utilization;
+
+public:
+	// Worker threads besides the main thread, which has to be the one constructing
+	explicit JobSystem(int workerCount);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Only while no jobs are in flight, e.g. between frames
+	void SetWorkerCount(int count);
+	inline int GetWorkerCount() const { return (int)m_Threads.size(); }
+	inline int GetThreadCount() const { return (int)m_Threads.size() + 1; }
+	// Of the calling thread: 0 for the main thread, 1 and up for workers, -1 for threads not owned by a job system
+	static int GetThreadIndex();
+
+	void Run(Function function, JobCounter* counter = nullptr);
+	void RunOnMainThread(Function function, JobCounter* counter = nullptr);
+	// Runs once every job counted by dependency has finished
+	void RunAfter(JobCounter& dependency, Function function, JobCounter* counter = nullptr, bool mainThread = false);
+	// Runs jobs until counter is done, main thread jobs too when called from the main thread
+	void Wait(JobCounter& counter);
+	void RunMainThreadJobs();
+
+	// body(begin, end) over [begin, end) in chunks, returns when all are done. The range is halved until
+	// chunks are about a quarter of an even share per thread (never below minChunk), the halves go into
+	// the deque so thieves take big pieces and split them further themselves.
+	template<typename Body>
+	void ParallelFor(size_t begin, size_t end, size_t minChunk, const Body& body);
+
+	// Closes the frame's utilization: per thread, the share of the frame spent running jobs
+	void EndFrame();
+	inline const std::vector<float>& GetUtilization() const { return m_Utilization; }
+
+private:
+	void StartWorkers(int count);
+	void StopWorkers();
+	void WorkerLoop(int index);
+
+	void Push(int index, Job&& job);
+	bool Pop(int index, Job& job);
+	bool Steal(int index, Job& job);
+	bool PopMainThread(Job& job);
+	// one job from wherever this thread may take one, false when there's nothing
+	bool RunOne();
+	void Execute(Job& job);
+	void Schedule(Function&& function, JobCounter* counter, bool mainThread);
+	void Finish(JobCounter* counter);
+};
+
+template<typename Body>
+void JobSystem::ParallelFor(size_t begin, size_t end, size_t minChunk, const Body& body)
+{
+	if (begin >= end)
+		return;
+
+	size_t chunk = std::max<size_t>(std::max<size_t>(minChunk, 1), (end - begin) / (GetThreadCount() * 4));
+	if (end - begin <= chunk)
+	{
+		body(begin, end);
+		return;
+	}
+
+	// everything below is referenced by the jobs, Wait keeps it alive until the last one is done
+	JobCounter counter;
+	auto split = [&](auto& self, size_t first, size_t last) -> void
+	{
+		while (last - first > chunk)
+		{
+			size_t middle = first + (last - first) / 2;
+			Run([&self, middle, last] { self(self, middle, last); }, &counter);
+			last = middle;
+		}
+		body(first, last);
+	};
+
+	split(split, begin, end);
+	Wait(counter);
+}
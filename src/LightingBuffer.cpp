@@ -0,0 +1,27 @@
+#include "LightingBuffer.h"
+
+#include <cstring>
+
+LightingBuffer::LightingBuffer(GLuint binding)
+	: m_Buffer(GL_UNIFORM_BUFFER, binding, sizeof(LightingParams)), m_HasParams(false), m_Written(false)
+{
+}
+
+void LightingBuffer::Update(const LightingParams& params)
+{
+	// the padding is zeroed on both sides, so bytes compare like members
+	m_Written = !m_HasParams || std::memcmp(&params, &m_Params, sizeof(LightingParams)) != 0;
+	if (!m_Written)
+		return;
+
+	std::memcpy(m_Buffer.BeginWrite(), &params, sizeof(LightingParams));
+	m_Buffer.EndWrite();
+	m_Params = params;
+	m_HasParams = true;
+}
+
+void LightingBuffer::EndFrame()
+{
+	if (m_Written)
+		m_Buffer.Lock();
+}
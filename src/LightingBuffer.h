@@ -0,0 +1,44 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+
+#include "StreamBuffer.h"
+
+// LightingParams block of the lit shaders, std140: a vec3 shares its 16 bytes with the float after it
+struct LightingParams
+{
+	glm::vec4 lightColor = glm::vec4(0.0f);
+	glm::vec3 lightPosition = glm::vec3(0.0f);
+	float attenuationConstant = 0.0f;
+	glm::vec3 viewPosition = glm::vec3(0.0f);
+	float attenuationLinear = 0.0f;
+	float attenuationQuadratic = 0.0f;
+	float specularStrength = 0.0f;
+	float specularShininess = 0.0f;
+	float padding = 0.0f;
+};
+static_assert(sizeof(LightingParams) == 64, "LightingParams has to match the std140 block");
+
+// Light and material parameters every lit program reads from one uniform block, so switching programs
+// doesn't re-set anything. Changed parameters go into the next region of a persistently mapped stream
+// buffer, which then gets bound; frames that change nothing don't write or bind, the bound region stays
+// valid because writes only ever go to the next one.
+class LightingBuffer
+{
+private:
+	StreamBuffer m_Buffer;
+	LightingParams m_Params;
+	bool m_HasParams;
+	bool m_Written;
+
+public:
+	explicit LightingBuffer(GLuint binding);
+
+	// Before the frame's draws, writes params if they differ from the last ones
+	void Update(const LightingParams& params);
+	// After the draws that read this frame's write
+	void EndFrame();
+
+	// whether the last Update wrote
+	inline bool WasWritten() const { return m_Written; }
+};
@@ -0,0 +1,113 @@
+#include "MortonOrder.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// spreads the low 10 bits of v two zeros apart: ...9876543210 -> 9..8..7..6..5..4..3..2..1..0
+static uint32_t SpreadBits(uint32_t v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+uint32_t MortonCode(glm::vec3 unit)
+{
+	glm::uvec3 cell = glm::uvec3(glm::clamp(unit * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f)));
+	return (SpreadBits(cell.x) << 2) | (SpreadBits(cell.y) << 1) | SpreadBits(cell.z);
+}
+
+// 8 bits a pass, the last of the four only has the top 6 of the 30
+static constexpr int RadixBits = 8;
+static constexpr uint32_t RadixBuckets = 1 << RadixBits;
+static constexpr int RadixPasses = 4;
+
+void SortByMortonCode(JobSystem& jobs, const BoundingSpheres& bounds, std::vector<uint32_t>& order)
+{
+	size_t count = bounds.Size();
+	order.resize(count);
+	if (count == 0)
+		return;
+
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 center(bounds.x[i], bounds.y[i], bounds.z[i]);
+		min = glm::min(min, center);
+		max = glm::max(max, center);
+	}
+	// flat axes (everything on the ground) map to 0
+	glm::vec3 scale = glm::vec3(1.0f) / glm::max(max - min, glm::vec3(FLT_MIN));
+
+	std::vector<uint32_t> codes(count);
+	jobs.ParallelFor(0, count, 64 * 1024, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			codes[i] = MortonCode((glm::vec3(bounds.x[i], bounds.y[i], bounds.z[i]) - min) * scale);
+			order[i] = (uint32_t)i;
+		}
+	});
+
+	if (count < ParallelMortonSortSize)
+	{
+		std::stable_sort(order.begin(), order.end(), [&codes](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+		return;
+	}
+
+	// fixed blocks rather than ParallelFor's own split, the scatter needs each block's histogram from the count
+	size_t blockCount = (size_t)jobs.GetThreadCount() * 4;
+	size_t blockSize = (count + blockCount - 1) / blockCount;
+	blockCount = (count + blockSize - 1) / blockSize;
+
+	std::vector<uint32_t> sortedCodes(count), sortedOrder(count);
+	std::vector<uint32_t> offsets(blockCount * RadixBuckets);
+
+	for (int pass = 0; pass < RadixPasses; pass++)
+	{
+		int shift = pass * RadixBits;
+
+		jobs.ParallelFor(0, blockCount, 1, [&](size_t firstBlock, size_t lastBlock)
+		{
+			for (size_t block = firstBlock; block < lastBlock; block++)
+			{
+				uint32_t* histogram = &offsets[block * RadixBuckets];
+				std::fill(histogram, histogram + RadixBuckets, 0u);
+				for (size_t i = block * blockSize, end = std::min(i + blockSize, count); i < end; i++)
+					histogram[(codes[i] >> shift) & (RadixBuckets - 1)]++;
+			}
+		});
+
+		// bucket major prefix sum: bucket b of block k starts after all smaller buckets and after bucket b of earlier blocks
+		uint32_t sum = 0;
+		for (uint32_t bucket = 0; bucket < RadixBuckets; bucket++)
+		{
+			for (size_t block = 0; block < blockCount; block++)
+			{
+				uint32_t blockBucket = offsets[block * RadixBuckets + bucket];
+				offsets[block * RadixBuckets + bucket] = sum;
+				sum += blockBucket;
+			}
+		}
+
+		jobs.ParallelFor(0, blockCount, 1, [&](size_t firstBlock, size_t lastBlock)
+		{
+			for (size_t block = firstBlock; block < lastBlock; block++)
+			{
+				uint32_t* next = &offsets[block * RadixBuckets];
+				for (size_t i = block * blockSize, end = std::min(i + blockSize, count); i < end; i++)
+				{
+					uint32_t target = next[(codes[i] >> shift) & (RadixBuckets - 1)]++;
+					sortedCodes[target] = codes[i];
+					sortedOrder[target] = order[i];
+				}
+			}
+		});
+
+		codes.swap(sortedCodes);
+		order.swap(sortedOrder);
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "InstanceStore.h"
+#include "JobSystem.h"
+
+// Morton (Z-order) codes interleave the bits of x, y and z, so points close in space mostly end up close
+// in the code as well. Sorting instances by it puts neighbours next to each other in memory: culling reads
+// visible runs instead of scattered instances, the GPU fetches neighbouring instances together.
+
+// 10 bits per axis of a point in [0, 1]^3, 30 bits in all
+uint32_t MortonCode(glm::vec3 unit);
+
+// Below this the sort is a plain std::sort, the radix passes don't pay for their histograms
+constexpr size_t ParallelMortonSortSize = 64 * 1024;
+
+// Indices of the spheres' centers ordered along the Morton curve through their bounding box:
+// order[i] is the instance that goes to index i. A parallel LSD radix sort over the codes, stable
+void SortByMortonCode(JobSystem& jobs, const BoundingSpheres& bounds, std::vector<uint32_t>& order);
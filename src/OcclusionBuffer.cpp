@@ -0,0 +1,247 @@
+#include "OcclusionBuffer.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cmath>
+
+// corner i of the unit cube has x, y, z from bits 0, 1, 2, faces list them around the perimeter
+static const int CubeFaces[6][4] = {
+	{ 0, 4, 6, 2 }, { 1, 3, 7, 5 },
+	{ 0, 1, 5, 4 }, { 2, 6, 7, 3 },
+	{ 0, 2, 3, 1 }, { 4, 5, 7, 6 }
+};
+
+// x and y are clipped at +-GuardBand * w, so projected vertices stay small enough for float edge equations
+static constexpr float GuardBand = 4.0f;
+// 4 vertices, each clip plane adds at most one
+static constexpr int MaxClipVertices = 4 + 5;
+
+// Sutherland-Hodgman against dot(plane, v) >= 0
+static int ClipPolygon(const glm::vec4* input, int count, const glm::vec4& plane, glm::vec4* output)
+{
+	int result = 0;
+	for (int i = 0; i < count; i++)
+	{
+		const glm::vec4& current = input[i];
+		const glm::vec4& next = input[(i + 1) % count];
+		float currentDistance = glm::dot(plane, current);
+		float nextDistance = glm::dot(plane, next);
+
+		if (currentDistance >= 0.0f)
+			output[result++] = current;
+		if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+			output[result++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+	}
+	return result;
+}
+
+OcclusionBuffer::OcclusionBuffer()
+	: m_Depth(Width * Height, 0.0f)
+{
+}
+
+void OcclusionBuffer::Clear(int firstRow, int lastRow)
+{
+	std::fill(m_Depth.begin() + firstRow * Width, m_Depth.begin() + lastRow * Width, 0.0f);
+}
+
+void OcclusionBuffer::RasterizeCube(const glm::mat4& modelViewProjection, int firstRow, int lastRow)
+{
+	glm::vec4 corners[8];
+	for (int i = 0; i < 8; i++)
+		corners[i] = modelViewProjection * glm::vec4((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f, 1.0f);
+
+	const glm::vec4 clipPlanes[5] = {
+		{ 0.0f, 0.0f, 1.0f, 1.0f }, // near, z >= -w
+		{ 1.0f, 0.0f, 0.0f, GuardBand }, { -1.0f, 0.0f, 0.0f, GuardBand },
+		{ 0.0f, 1.0f, 0.0f, GuardBand }, { 0.0f, -1.0f, 0.0f, GuardBand }
+	};
+
+	// back faces are rasterized too, they're never nearer than the front faces so the result is the same
+	for (const int (&face)[4] : CubeFaces)
+	{
+		glm::vec4 polygon[MaxClipVertices], clipped[MaxClipVertices];
+		int count = 4;
+		for (int i = 0; i < 4; i++)
+			polygon[i] = corners[face[i]];
+
+		for (const glm::vec4& plane : clipPlanes)
+		{
+			count = ClipPolygon(polygon, count, plane, clipped);
+			std::copy(clipped, clipped + count, polygon);
+		}
+		if (count < 3)
+			continue;
+
+		glm::vec3 screen[MaxClipVertices];
+		for (int i = 0; i < count; i++)
+		{
+			float inverseW = 1.0f / polygon[i].w;
+			screen[i] = glm::vec3((polygon[i].x * inverseW * 0.5f + 0.5f) * Width, (polygon[i].y * inverseW * 0.5f + 0.5f) * Height, inverseW);
+		}
+		RasterizePolygon(screen, count, firstRow, lastRow);
+	}
+}
+
+void OcclusionBuffer::RasterizePolygon(const glm::vec3* vertices, int count, int firstRow, int lastRow)
+{
+	// twice the signed area, anything under a pixel can't fully cover one
+	float area = 0.0f;
+	for (int i = 0; i < count; i++)
+	{
+		const glm::vec3& a = vertices[i];
+		const glm::vec3& b = vertices[(i + 1) % count];
+		area += a.x * b.y - b.x * a.y;
+	}
+	if (std::abs(area) < 2.0f)
+		return;
+	float orientation = area > 0.0f ? 1.0f : -1.0f;
+
+	// edge functions, positive inside. A pixel is fully covered when its center is at least
+	// (|a| + |b|) / 2 inside every edge, that's where the worst of its corners is still on the edge
+	float edgeA[MaxClipVertices], edgeB[MaxClipVertices], edgeC[MaxClipVertices];
+	int edges = 0;
+	for (int i = 0; i < count; i++)
+	{
+		const glm::vec3& from = vertices[i];
+		const glm::vec3& to = vertices[(i + 1) % count];
+		float a = (from.y - to.y) * orientation;
+		float b = (to.x - from.x) * orientation;
+		float inset = 0.5f * (std::abs(a) + std::abs(b));
+		if (inset < 1e-6f)
+			continue; // clipping can leave duplicate vertices
+
+		edgeA[edges] = a;
+		edgeB[edges] = b;
+		edgeC[edges] = -(a * from.x + b * from.y) - inset;
+		edges++;
+	}
+
+	// 1/w is a plane in screen space, taken from the best conditioned fan triangle
+	int best = 1;
+	float bestDet = 0.0f;
+	for (int i = 1; i + 1 < count; i++)
+	{
+		glm::vec2 e1 = glm::vec2(vertices[i]) - glm::vec2(vertices[0]);
+		glm::vec2 e2 = glm::vec2(vertices[i + 1]) - glm::vec2(vertices[0]);
+		float det = e1.x * e2.y - e2.x * e1.y;
+		if (std::abs(det) > std::abs(bestDet))
+		{
+			best = i;
+			bestDet = det;
+		}
+	}
+
+	const glm::vec3& v0 = vertices[0];
+	glm::vec3 e1 = vertices[best] - v0;
+	glm::vec3 e2 = vertices[best + 1] - v0;
+	float depthA = (e1.z * e2.y - e2.z * e1.y) / bestDet;
+	float depthB = (e2.z * e1.x - e1.z * e2.x) / bestDet;
+	// the farthest the polygon gets inside the pixel
+	float depthC = v0.z - depthA * v0.x - depthB * v0.y - 0.5f * (std::abs(depthA) + std::abs(depthB));
+
+	float minX = vertices[0].x, maxX = vertices[0].x, minY = vertices[0].y, maxY = vertices[0].y;
+	for (int i = 1; i < count; i++)
+	{
+		minX = std::min(minX, vertices[i].x);
+		maxX = std::max(maxX, vertices[i].x);
+		minY = std::min(minY, vertices[i].y);
+		maxY = std::max(maxY, vertices[i].y);
+	}
+
+	int xBegin = std::max(0, (int)std::floor(minX)) & ~3;
+	int xEnd = std::min(Width, (int)std::ceil(maxX));
+	int yBegin = std::max(firstRow, (int)std::floor(minY));
+	int yEnd = std::min(lastRow, (int)std::ceil(maxY));
+
+	for (int y = yBegin; y < yEnd; y++)
+	{
+		float* row = &m_Depth[y * Width];
+		float py = y + 0.5f;
+
+#ifdef SIMD_X86
+		__m128 rowC[MaxClipVertices];
+		for (int e = 0; e < edges; e++)
+			rowC[e] = _mm_set1_ps(edgeB[e] * py + edgeC[e]);
+		__m128 rowDepth = _mm_set1_ps(depthB * py + depthC);
+		const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+		for (int x = xBegin; x < xEnd; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffset);
+
+			__m128 inside = _mm_cmpeq_ps(px, px);
+			for (int e = 0; e < edges; e++)
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[e]), px), rowC[e]), _mm_setzero_ps()));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthA), px), rowDepth);
+			__m128 current = _mm_loadu_ps(row + x);
+			__m128 nearest = _mm_max_ps(current, depth);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+		}
+#else
+		for (int x = xBegin; x < xEnd; x++)
+		{
+			float px = x + 0.5f;
+
+			bool inside = true;
+			for (int e = 0; e < edges && inside; e++)
+				inside = edgeA[e] * px + edgeB[e] * py + edgeC[e] >= 0.0f;
+
+			if (inside)
+				row[x] = std::max(row[x], depthA * px + depthB * py + depthC);
+		}
+#endif
+	}
+}
+
+bool OcclusionBuffer::IsRectOccluded(int x0, int y0, int x1, int y1, float inverseDepth) const
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, Width - 1);
+	y1 = std::min(y1, Height - 1);
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	for (int y = y0; y <= y1; y++)
+	{
+		const float* row = GetRow(y);
+		for (int x = x0; x <= x1; x++)
+			if (row[x] <= inverseDepth)
+				return false;
+	}
+	return true;
+}
+
+bool OcclusionBuffer::IsSphereOccluded(const glm::vec3& viewCenter, float radius, const glm::mat4& projection) const
+{
+	// same bounds as cull.shader: 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere (Mara and McGuire 2013)
+	float depth = -viewCenter.z;
+	float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+	if (depth - radius < zNear)
+		return false;
+
+	glm::vec2 cx(viewCenter.x, depth);
+	glm::vec2 vx(std::sqrt(glm::dot(cx, cx) - radius * radius), radius);
+	glm::vec2 minX = glm::mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
+	glm::vec2 maxX = glm::mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
+
+	glm::vec2 cy(viewCenter.y, depth);
+	glm::vec2 vy(std::sqrt(glm::dot(cy, cy) - radius * radius), radius);
+	glm::vec2 minY = glm::mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
+	glm::vec2 maxY = glm::mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
+
+	glm::vec4 box(minX.x / minX.y * projection[0][0], minY.x / minY.y * projection[1][1],
+		maxX.x / maxX.y * projection[0][0], maxY.x / maxY.y * projection[1][1]);
+	box = glm::clamp(box * 0.5f + 0.5f, 0.0f, 1.0f);
+
+	int x0 = (int)std::floor(box.x * Width);
+	int y0 = (int)std::floor(box.y * Height);
+	int x1 = std::max(x0, (int)std::ceil(box.z * Width) - 1);
+	int y1 = std::max(y0, (int)std::ceil(box.w * Height) - 1);
+
+	return IsRectOccluded(x0, y0, x1, y1, 1.0f / (depth - radius));
+}
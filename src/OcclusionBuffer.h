@@ -0,0 +1,37 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Low resolution depth buffer for software occlusion culling, no GL involved.
+// Occluders are rasterized conservatively: a pixel is only written when the occluder covers all of it,
+// with the farthest depth the occluder has inside it. Depth is stored as 1/w (0 = nothing rendered),
+// which is linear in screen space, so larger values are nearer.
+class OcclusionBuffer
+{
+public:
+	static constexpr int Width = 256;  // multiple of 4, rows are processed 4 pixels at a time
+	static constexpr int Height = 144;
+
+private:
+	std::vector<float> m_Depth;
+
+public:
+	OcclusionBuffer();
+
+	// Rows are [firstRow, lastRow), so bands can be filled by different threads
+	void Clear(int firstRow, int lastRow);
+	// Unit cube (corners at +-0.5) transformed by modelViewProjection, faces are clipped to the near plane
+	void RasterizeCube(const glm::mat4& modelViewProjection, int firstRow, int lastRow);
+
+	// True when every pixel of the inclusive rect holds an occluder nearer than inverseDepth (1/w)
+	bool IsRectOccluded(int x0, int y0, int x1, int y1, float inverseDepth) const;
+	// Sphere given in view space, tested with its projected bounds and nearest point
+	bool IsSphereOccluded(const glm::vec3& viewCenter, float radius, const glm::mat4& projection) const;
+
+	inline const float* GetRow(int y) const { return &m_Depth[y * Width]; }
+
+private:
+	// Convex polygon in buffer pixels, z is 1/w
+	void RasterizePolygon(const glm::vec3* vertices, int count, int firstRow, int lastRow);
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+
+// xoshiro128+ (Blackman and Vigna), seeded through splitmix64. A few cycles per number and the same
+// sequence on every platform, unlike rand(). Meant for spawning scenes, not for anything statistical.
+class Random
+{
+private:
+	uint32_t m_State[4];
+
+public:
+	explicit Random(uint64_t seed)
+	{
+		for (int i = 0; i < 4; i += 2)
+		{
+			seed += 0x9E3779B97F4A7C15ull;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			z ^= z >> 31;
+			m_State[i] = (uint32_t)z;
+			m_State[i + 1] = (uint32_t)(z >> 32);
+		}
+	}
+
+	inline uint32_t Next()
+	{
+		uint32_t result = m_State[0] + m_State[3];
+		uint32_t t = m_State[1] << 9;
+
+		m_State[2] ^= m_State[0];
+		m_State[3] ^= m_State[1];
+		m_State[1] ^= m_State[2];
+		m_State[0] ^= m_State[3];
+		m_State[2] ^= t;
+		m_State[3] = (m_State[3] << 11) | (m_State[3] >> 21);
+		return result;
+	}
+
+	// [0, 1), from the top 24 bits since the low ones of xoshiro+ are weak
+	inline float NextFloat() { return (Next() >> 8) * (1.0f / 16777216.0f); }
+	inline float Range(float min, float max) { return min + (max - min) * NextFloat(); }
+	// [0, count)
+	inline uint32_t Below(uint32_t count) { return (uint32_t)(((uint64_t)Next() * count) >> 32); }
+};
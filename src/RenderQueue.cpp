@@ -0,0 +1,123 @@
+#include "RenderQueue.h"
+#include "GLState.h"
+#include "renderer.h"
+
+#include <algorithm>
+
+static constexpr int ProgramBits = 10;
+static constexpr int MaterialBits = 12;
+static constexpr int VertexArrayBits = 10;
+static constexpr int DepthBits = 24;
+
+static uint64_t Field(uint64_t value, int bits)
+{
+	return value & ((1ull << bits) - 1);
+}
+
+uint64_t MakeRenderKey(RenderPass pass, bool transparent, GLuint program, GLuint material, GLuint vertexArray, float depth)
+{
+	uint64_t quantizedDepth = (uint64_t)(std::clamp(depth, 0.0f, 1.0f) * (float)((1 << DepthBits) - 1));
+	uint64_t state = (Field(program, ProgramBits) << (MaterialBits + VertexArrayBits))
+		| (Field(material, MaterialBits) << VertexArrayBits)
+		| Field(vertexArray, VertexArrayBits);
+
+	uint64_t key = ((uint64_t)pass << 60) | ((uint64_t)transparent << 59);
+	// 35 bits of state, 24 of depth below the pass and transparent bit
+	if (transparent)
+		key |= (((1ull << DepthBits) - 1 - quantizedDepth) << 35) | state;
+	else
+		key |= (state << DepthBits) | quantizedDepth;
+	return key;
+}
+
+RenderQueue::RenderQueue()
+	: m_LastCommandCount(0), m_LastStateChanges(0)
+{
+}
+
+void RenderQueue::Submit(uint64_t key, RenderCommand&& command)
+{
+	m_Entries.push_back({ key, (uint32_t)m_Commands.size() });
+	m_Commands.push_back(std::move(command));
+}
+
+void RenderQueue::Flush()
+{
+	Sort();
+
+	// counted where they're issued, callbacks switch programs too (the late occlusion cull does)
+	size_t switches = GLState::GetBindingSwitches();
+	for (const Entry& entry : m_Entries)
+		Execute(m_Commands[entry.command]);
+	m_LastStateChanges = GLState::GetBindingSwitches() - switches;
+
+	m_LastCommandCount = m_Commands.size();
+	m_Commands.clear();
+	m_Entries.clear();
+}
+
+void RenderQueue::Sort()
+{
+	size_t count = m_Entries.size();
+	if (count < RadixSortSize)
+	{
+		std::sort(m_Entries.begin(), m_Entries.end(), [](const Entry& a, const Entry& b)
+		{
+			return a.key < b.key || (a.key == b.key && a.command < b.command);
+		});
+		return;
+	}
+
+	// LSD over the 8 bytes, stable, so equal keys stay in submission order. Every byte's histogram comes
+	// from one read, bytes all keys share (unused fields, the pass) are skipped
+	uint32_t histograms[8][256] = {};
+	for (const Entry& entry : m_Entries)
+		for (int byte = 0; byte < 8; byte++)
+			histograms[byte][(entry.key >> (byte * 8)) & 0xff]++;
+
+	m_Scratch.resize(count);
+	for (int byte = 0; byte < 8; byte++)
+	{
+		uint32_t* histogram = histograms[byte];
+		if (histogram[(m_Entries[0].key >> (byte * 8)) & 0xff] == count)
+			continue;
+
+		uint32_t sum = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			uint32_t bucketCount = histogram[bucket];
+			histogram[bucket] = sum;
+			sum += bucketCount;
+		}
+
+		for (const Entry& entry : m_Entries)
+			m_Scratch[histogram[(entry.key >> (byte * 8)) & 0xff]++] = entry;
+		m_Entries.swap(m_Scratch);
+	}
+}
+
+void RenderQueue::Execute(RenderCommand& command)
+{
+	if (command.shader)
+		command.shader->Bind();
+	if (command.vertexArray)
+		GLState::BindVertexArray(command.vertexArray);
+	if (command.texture)
+		GLState::BindTexture(0, command.texture);
+
+	if (command.draw)
+		command.draw();
+	else if (command.indices)
+	{
+		command.indices->Bind();
+		GLCall(glDrawElements(command.mode, command.indices->GetCount(), GL_UNSIGNED_INT, nullptr));
+	}
+	else if (command.instanceCount != 1)
+	{
+		GLCall(glDrawArraysInstanced(command.mode, command.first, command.count, command.instanceCount));
+	}
+	else
+	{
+		GLCall(glDrawArrays(command.mode, command.first, command.count));
+	}
+}
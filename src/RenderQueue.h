@@ -0,0 +1,81 @@
+#pragma once
+#include <glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "IndexBuffer.h"
+#include "JobFunction.h"
+#include "Shader.h"
+
+// Passes run in order, whatever is submitted to them
+enum class RenderPass : uint8_t
+{
+	Opaque = 0,
+	// after the opaque pass is in the depth buffer, e.g. the occlusion culler's late draw
+	Late = 1,
+	Overlay = 2
+};
+
+// 64 bit draw order: pass (4 bits), transparent (1), then for opaque draws program (10), material (12),
+// vertex array (10) and depth (24, near first) so state changes as little as possible and early z does
+// its work; transparent draws go back to front first and by state after that. Names are masked to their
+// field, two names sharing the low bits only cost a state change. depth is in [0, 1], e.g. view distance
+// over the far plane
+uint64_t MakeRenderKey(RenderPass pass, bool transparent, GLuint program, GLuint material, GLuint vertexArray, float depth);
+
+// Binds whatever the draw needs (nothing it leaves at 0) and draws count vertices, or every index of
+// indices. A draw callback replaces the draw and runs with the state bound, for per draw uniforms or
+// indirect draws
+struct RenderCommand
+{
+	const Shader* shader = nullptr;
+	GLuint vertexArray = 0;
+	GLuint texture = 0; // unit 0
+	const IndexBuffer* indices = nullptr;
+	GLenum mode = GL_TRIANGLES;
+	GLint first = 0;
+	GLsizei count = 0;
+	GLsizei instanceCount = 1;
+	JobFunction draw;
+};
+
+// Deferred draws: Submit records them with a sort key, Flush radix sorts the keys and executes the
+// commands in order through GLState, so only state that changes between neighbours is bound. Storage
+// is kept between frames, a steady frame doesn't allocate. Main (GL) thread only.
+class RenderQueue
+{
+private:
+	// below this the keys are sorted with std::sort, the radix passes don't pay for their histograms
+	static constexpr size_t RadixSortSize = 256;
+
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t command; // submission order breaks ties
+	};
+
+	std::vector<RenderCommand> m_Commands;
+	std::vector<Entry> m_Entries;
+	std::vector<Entry> m_Scratch;
+
+	size_t m_LastCommandCount;
+	size_t m_LastStateChanges;
+
+public:
+	RenderQueue();
+
+	void Submit(uint64_t key, RenderCommand&& command);
+	// Sorts and executes everything submitted since the last flush
+	void Flush();
+
+	// of the last flush, state changes count the program, vertex array and texture binds it issued,
+	// including the ones draw callbacks made
+	inline size_t GetLastCommandCount() const { return m_LastCommandCount; }
+	inline size_t GetLastStateChanges() const { return m_LastStateChanges; }
+
+private:
+	void Sort();
+	void Execute(RenderCommand& command);
+};
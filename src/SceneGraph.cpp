@@ -0,0 +1,227 @@
+#include "SceneGraph.h"
+#include "Cubes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+SceneGraph::SceneGraph(JobSystem& jobs)
+	: m_Jobs(jobs), m_LayoutStale(false), m_UpdatedCount(0), m_UpdateMs(0.0f)
+{
+}
+
+SceneNode SceneGraph::Create(SceneNode parent, const InstanceStore::Transform& local, InstanceHandle instance)
+{
+	SceneNode node = (SceneNode)m_ParentOf.size();
+	m_ParentOf.push_back(parent);
+	m_ChildrenOf.emplace_back();
+	m_LocalOf.push_back(local);
+	m_InstanceOf.push_back(instance);
+	m_Slots.push_back(NoIndex);
+
+	if (parent == NoSceneNode)
+		m_Roots.push_back(node);
+	else
+		m_ChildrenOf[parent].push_back(node);
+
+	if (instance != NoInstance)
+	{
+		if (instance >= m_NodeOfInstance.size())
+			m_NodeOfInstance.resize(instance + 1, NoSceneNode);
+		m_NodeOfInstance[instance] = node;
+	}
+
+	m_LayoutStale = true;
+	return node;
+}
+
+void SceneGraph::SetParent(SceneNode node, SceneNode parent)
+{
+	std::vector<SceneNode>& siblings = m_ParentOf[node] == NoSceneNode ? m_Roots : m_ChildrenOf[m_ParentOf[node]];
+	siblings.erase(std::find(siblings.begin(), siblings.end(), node));
+
+	m_ParentOf[node] = parent;
+	if (parent == NoSceneNode)
+		m_Roots.push_back(node);
+	else
+		m_ChildrenOf[parent].push_back(node);
+	m_LayoutStale = true;
+}
+
+void SceneGraph::SetLocalTransform(SceneNode node, const InstanceStore::Transform& local)
+{
+	m_LocalOf[node] = local;
+
+	// a stale layout recomputes everything anyway
+	if (m_LayoutStale)
+		return;
+
+	uint32_t index = m_Slots[node];
+	m_LocalMatrices[index] = Cubes::MakeMatrix(local.position, local.scale, local.rotation);
+	m_Dirty.Add(index);
+}
+
+const InstanceStore::Transform& SceneGraph::GetLocalTransform(SceneNode node) const
+{
+	return m_LocalOf[node];
+}
+
+const glm::mat4& SceneGraph::GetWorldMatrix(SceneNode node) const
+{
+	static const glm::mat4 Identity(1.0f);
+	uint32_t index = m_Slots[node];
+	return index == NoIndex ? Identity : m_Worlds[index];
+}
+
+void SceneGraph::UnbindInstance(InstanceHandle instance)
+{
+	if (instance >= m_NodeOfInstance.size() || m_NodeOfInstance[instance] == NoSceneNode)
+		return;
+
+	SceneNode node = m_NodeOfInstance[instance];
+	m_NodeOfInstance[instance] = NoSceneNode;
+	m_InstanceOf[node] = NoInstance;
+	if (m_Slots[node] != NoIndex)
+		m_Instances[m_Slots[node]] = NoInstance;
+}
+
+void SceneGraph::Relayout()
+{
+	// breadth first, a level at a time
+	m_Nodes.assign(m_Roots.begin(), m_Roots.end());
+	m_FirstChild.clear();
+	m_ChildCount.clear();
+	m_LevelStart.assign(1, 0);
+	for (size_t begin = 0; begin < m_Nodes.size();)
+	{
+		size_t end = m_Nodes.size();
+		for (size_t i = begin; i < end; i++)
+		{
+			const std::vector<SceneNode>& children = m_ChildrenOf[m_Nodes[i]];
+			m_FirstChild.push_back((uint32_t)m_Nodes.size());
+			m_ChildCount.push_back((uint32_t)children.size());
+			m_Nodes.insert(m_Nodes.end(), children.begin(), children.end());
+		}
+		m_LevelStart.push_back((uint32_t)end);
+		begin = end;
+	}
+
+	size_t count = m_Nodes.size();
+	for (size_t i = 0; i < count; i++)
+		m_Slots[m_Nodes[i]] = (uint32_t)i;
+
+	m_Parents.resize(count);
+	m_LocalMatrices.resize(count);
+	m_Worlds.resize(count);
+	m_Instances.resize(count);
+	m_Jobs.ParallelFor(0, count, ParallelPropagateBatch, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			SceneNode node = m_Nodes[i];
+			m_Parents[i] = m_ParentOf[node] == NoSceneNode ? NoIndex : m_Slots[m_ParentOf[node]];
+			const InstanceStore::Transform& local = m_LocalOf[node];
+			m_LocalMatrices[i] = Cubes::MakeMatrix(local.position, local.scale, local.rotation);
+			m_Instances[i] = m_InstanceOf[node];
+		}
+	});
+}
+
+void SceneGraph::Propagate(size_t begin, size_t end)
+{
+	m_Jobs.ParallelFor(begin, end, ParallelPropagateBatch, [this](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+			m_Worlds[i] = m_Parents[i] == NoIndex ? m_LocalMatrices[i] : m_Worlds[m_Parents[i]] * m_LocalMatrices[i];
+	});
+}
+
+// inverse of Cubes::MakeMatrix, translate * rotateX * rotateY * rotateZ * scale, for matrices without shear
+static InstanceStore::Transform Decompose(const glm::mat4& matrix)
+{
+	InstanceStore::Transform transform;
+	transform.position = glm::vec3(matrix[3]);
+	transform.scale = glm::vec3(glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2])));
+
+	// rotation columns: [2][0] = sin y, [2][1] = -sin x cos y, [2][2] = cos x cos y, [1][0] = -cos y sin z, [0][0] = cos y cos z
+	glm::mat3 rotation(glm::vec3(matrix[0]) / transform.scale.x, glm::vec3(matrix[1]) / transform.scale.y, glm::vec3(matrix[2]) / transform.scale.z);
+	transform.rotation.x = std::atan2(-rotation[2][1], rotation[2][2]);
+	transform.rotation.y = std::asin(glm::clamp(rotation[2][0], -1.0f, 1.0f));
+	transform.rotation.z = std::atan2(-rotation[1][0], rotation[0][0]);
+	return transform;
+}
+
+void SceneGraph::Update(InstanceStore& instances)
+{
+	m_ChangedInstances.clear();
+	m_ChangedTransforms.clear();
+	m_ChangedMatrices.clear();
+	m_UpdatedCount = 0;
+
+	if (m_LayoutStale)
+	{
+		Relayout();
+		m_LayoutStale = false;
+		m_Dirty.Clear();
+		m_Dirty.Add(0, m_Nodes.size());
+	}
+	if (m_Dirty.Empty())
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// a level's dirty runs only depend on the levels above, which are done by then. Each run's children
+	// are one run on the next level, merged into whatever changed there on its own
+	for (size_t level = 0; level + 1 < m_LevelStart.size(); level++)
+	{
+		size_t levelBegin = m_LevelStart[level], levelEnd = m_LevelStart[level + 1];
+		if (m_Dirty.GetRanges().back().end <= levelBegin)
+			break;
+
+		m_LevelRuns.clear();
+		for (const DirtyRanges::Range& range : m_Dirty.GetRanges())
+		{
+			if (range.begin >= levelEnd)
+				break;
+			if (range.end > levelBegin)
+				m_LevelRuns.push_back({ std::max(range.begin, levelBegin), std::min(range.end, levelEnd) });
+		}
+
+		m_Jobs.ParallelFor(0, m_LevelRuns.size(), 1, [this](size_t begin, size_t end)
+		{
+			for (size_t run = begin; run < end; run++)
+				Propagate(m_LevelRuns[run].begin, m_LevelRuns[run].end);
+		});
+
+		for (const DirtyRanges::Range& run : m_LevelRuns)
+		{
+			m_Dirty.Add(m_FirstChild[run.begin], m_FirstChild[run.end - 1] + m_ChildCount[run.end - 1]);
+			m_UpdatedCount += run.end - run.begin;
+		}
+	}
+
+	// everything recomputed is in m_Dirty now
+	for (const DirtyRanges::Range& range : m_Dirty.GetRanges())
+	{
+		for (size_t i = range.begin; i < range.end; i++)
+		{
+			if (m_Instances[i] != NoInstance)
+			{
+				m_ChangedInstances.push_back(m_Instances[i]);
+				m_ChangedMatrices.push_back(m_Worlds[i]);
+			}
+		}
+	}
+	m_Dirty.Clear();
+
+	m_ChangedTransforms.resize(m_ChangedMatrices.size());
+	m_Jobs.ParallelFor(0, m_ChangedMatrices.size(), ParallelPropagateBatch, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			m_ChangedTransforms[i] = Decompose(m_ChangedMatrices[i]);
+	});
+	if (!m_ChangedInstances.empty())
+		instances.SetTransforms(m_ChangedInstances.data(), m_ChangedTransforms.data(), m_ChangedMatrices.data(), m_ChangedInstances.size());
+
+	m_UpdateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "DirtyRanges.h"
+#include "InstanceStore.h"
+#include "JobSystem.h"
+
+// Stable node id, never reused
+typedef uint32_t SceneNode;
+constexpr SceneNode NoSceneNode = ~0u;
+constexpr InstanceHandle NoInstance = ~0u;
+
+// Transform hierarchy over the instances: a node's world matrix is its parent's times its own local
+// position/scale/rotation (Cubes::MakeMatrix), nodes bound to an instance drive its transform.
+//
+// Nodes are laid out breadth first, so the array is sorted by depth, a node's children are next to each
+// other and the children of consecutive nodes are consecutive. Whatever lies below a run of nodes is then
+// one run per level: Update recomputes the runs below the nodes whose local transform changed, a level
+// at a time, so moving one parent costs a pass over just its subtree. Runs of a level are independent and
+// split into jobs. Adding nodes or reparenting lays the array out again on the next Update.
+//
+// Bound instances get their world matrix as is, and its decomposition into position/scale/rotation for the
+// bounds and the compact format (exact unless scaled parents shear their rotated children).
+class SceneGraph
+{
+private:
+	static constexpr uint32_t NoIndex = ~0u;
+	// runs over this are split into jobs
+	static constexpr size_t ParallelPropagateBatch = 4 * 1024;
+
+	JobSystem& m_Jobs;
+
+	// per node id, what the layout is built from
+	std::vector<SceneNode> m_ParentOf;
+	std::vector<std::vector<SceneNode>> m_ChildrenOf;
+	std::vector<InstanceStore::Transform> m_LocalOf;
+	std::vector<InstanceHandle> m_InstanceOf;
+	std::vector<SceneNode> m_Roots;
+	std::vector<uint32_t> m_Slots; // node -> layout index
+	bool m_LayoutStale;
+
+	// layout order
+	std::vector<SceneNode> m_Nodes;
+	std::vector<uint32_t> m_Parents; // layout index, NoIndex for roots
+	std::vector<uint32_t> m_FirstChild; // never decreases, leaves hold where their children would start
+	std::vector<uint32_t> m_ChildCount;
+	std::vector<uint32_t> m_LevelStart; // level l is [m_LevelStart[l], m_LevelStart[l + 1])
+	std::vector<glm::mat4> m_LocalMatrices;
+	std::vector<glm::mat4> m_Worlds;
+	std::vector<InstanceHandle> m_Instances;
+
+	// layout indices whose local transform changed since the last Update
+	DirtyRanges m_Dirty;
+	std::vector<DirtyRanges::Range> m_LevelRuns;
+
+	// instance -> node bound to it
+	std::vector<SceneNode> m_NodeOfInstance;
+
+	// what the last Update wrote to the instance store
+	std::vector<InstanceHandle> m_ChangedInstances;
+	std::vector<InstanceStore::Transform> m_ChangedTransforms;
+	std::vector<glm::mat4> m_ChangedMatrices;
+	size_t m_UpdatedCount;
+	float m_UpdateMs;
+
+public:
+	SceneGraph(JobSystem& jobs);
+
+	// New node under parent (NoSceneNode for a root), driving instance if there is one
+	SceneNode Create(SceneNode parent, const InstanceStore::Transform& local, InstanceHandle instance = NoInstance);
+	// Keeps the local transform, so the node moves with its new parent. parent must not be below node
+	void SetParent(SceneNode node, SceneNode parent);
+	void SetLocalTransform(SceneNode node, const InstanceStore::Transform& local);
+	const InstanceStore::Transform& GetLocalTransform(SceneNode node) const;
+	// As of the last Update
+	const glm::mat4& GetWorldMatrix(SceneNode node) const;
+
+	// The instance is going away, the node stays as a plain transform
+	void UnbindInstance(InstanceHandle instance);
+
+	// Recomputes the world matrices below changed nodes and writes the bound instances' transforms
+	void Update(InstanceStore& instances);
+
+	inline size_t Size() const { return m_ParentOf.size(); }
+	// bound instances the last Update moved, with their new transforms
+	inline const std::vector<InstanceHandle>& GetChangedInstances() const { return m_ChangedInstances; }
+	inline const std::vector<InstanceStore::Transform>& GetChangedTransforms() const { return m_ChangedTransforms; }
+	// nodes the last Update recomputed and how long it took
+	inline size_t GetUpdatedCount() const { return m_UpdatedCount; }
+	inline float GetUpdateMs() const { return m_UpdateMs; }
+
+private:
+	void Relayout();
+	void Propagate(size_t begin, size_t end);
+};
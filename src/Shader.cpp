@@ -3,55 +3,102 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <cstring>
 
 
+#include "GLState.h"
 #include "renderer.h"
 
 
 Shader::Shader(const std::string& filepath) : m_FilePath(filepath), m_RendererID(0)
 {
 	ShaderSource source = ParseShader(filepath);
-	m_RendererID = CreateShader(source.VertexSource, source.FragmentSource);
+	if (!source.ComputeSource.empty())
+		m_RendererID = CreateComputeShader(source.ComputeSource);
+	else
+		m_RendererID = CreateShader(source.VertexSource, source.FragmentSource);
+	ReflectUniforms();
 }
 
 Shader::~Shader()
 {
-	GLCall(glDeleteProgram(m_RendererID));
+	GLState::DeleteProgram(m_RendererID);
 }
 
 void Shader::Bind() const
 {
-	GLCall(glUseProgram(m_RendererID));
+	GLState::UseProgram(m_RendererID);
 }
 
 void Shader::Unbind() const
 {
-	GLCall(glUseProgram(0));
+	GLState::UseProgram(0);
 }
 
-void Shader::SetUniform1i(const std::string& name, int value)
+void Shader::Dispatch(GLuint groupsX, GLuint groupsY, GLuint groupsZ) const
 {
-	GLCall(glUniform1i(GetUniformLocation(name), value));
+	GLCall(glDispatchCompute(groupsX, groupsY, groupsZ));
 }
 
-void Shader::SetUniform1f(const std::string& name, float value)
+void Shader::SetUniform(Uniform<int> uniform, int value) const
 {
-	GLCall(glUniform1f(GetUniformLocation(name), value));
+	GLCall(glProgramUniform1i(m_RendererID, uniform.location, value));
 }
 
-void Shader::SetUniform3f(const std::string& name, const glm::vec3& vec3)
+void Shader::SetUniform(Uniform<unsigned int> uniform, unsigned int value) const
 {
-	GLCall(glUniform3f(GetUniformLocation(name), vec3.x, vec3.y, vec3.z));
+	GLCall(glProgramUniform1ui(m_RendererID, uniform.location, value));
 }
 
-void Shader::SetUniformMat4f(const std::string& name, const glm::mat4& mat)
+void Shader::SetUniform(Uniform<float> uniform, float value) const
 {
-	GLCall(glUniformMatrix4fv(GetUniformLocation(name), 1, GL_FALSE, &mat[0][0]));
+	GLCall(glProgramUniform1f(m_RendererID, uniform.location, value));
 }
 
-void Shader::SetUniform4f(const std::string& name, const glm::vec4& vec4)
+void Shader::SetUniform(Uniform<glm::vec3> uniform, const glm::vec3& vec3) const
 {
-	GLCall(glUniform4f(GetUniformLocation(name), vec4.x, vec4.y, vec4.z, vec4.w));
+	GLCall(glProgramUniform3f(m_RendererID, uniform.location, vec3.x, vec3.y, vec3.z));
+}
+
+void Shader::SetUniform(Uniform<glm::vec4> uniform, const glm::vec4& vec4) const
+{
+	GLCall(glProgramUniform4f(m_RendererID, uniform.location, vec4.x, vec4.y, vec4.z, vec4.w));
+}
+
+void Shader::SetUniform(Uniform<glm::mat4> uniform, const glm::mat4& mat) const
+{
+	GLCall(glProgramUniformMatrix4fv(m_RendererID, uniform.location, 1, GL_FALSE, &mat[0][0]));
+}
+
+void Shader::SetUniform1i(const char* name, int value) const
+{
+	SetUniform(GetUniform<int>(name), value);
+}
+
+void Shader::SetUniform1ui(const char* name, unsigned int value) const
+{
+	SetUniform(GetUniform<unsigned int>(name), value);
+}
+
+void Shader::SetUniform1f(const char* name, float value) const
+{
+	SetUniform(GetUniform<float>(name), value);
+}
+
+void Shader::SetUniform3f(const char* name, const glm::vec3& vec3) const
+{
+	SetUniform(GetUniform<glm::vec3>(name), vec3);
+}
+
+void Shader::SetUniformMat4f(const char* name, const glm::mat4& mat) const
+{
+	SetUniform(GetUniform<glm::mat4>(name), mat);
+}
+
+void Shader::SetUniform4f(const char* name, const glm::vec4& vec4) const
+{
+	SetUniform(GetUniform<glm::vec4>(name), vec4);
 }
 
 ShaderSource Shader::ParseShader(const std::string& filepath)
@@ -62,12 +109,13 @@ ShaderSource Shader::ParseShader(const std::string& filepath)
 	{
 		NONE = -1,
 		VERTEX = 0,
-		FRAGMENT = 1
+		FRAGMENT = 1,
+		COMPUTE = 2
 	};
 	using enum ShaderType;
 
 	std::string line;
-	std::stringstream ss[2];
+	std::stringstream ss[3];
 	ShaderType type = NONE;
 
 	while (getline(stream, line))
@@ -78,6 +126,8 @@ ShaderSource Shader::ParseShader(const std::string& filepath)
 				type = VERTEX;
 			else if (line.find("fragment") != std::string::npos)
 				type = FRAGMENT;
+			else if (line.find("compute") != std::string::npos)
+				type = COMPUTE;
 		}
 		else
 		{
@@ -85,7 +135,7 @@ ShaderSource Shader::ParseShader(const std::string& filepath)
 		}
 	}
 
-	return { ss[0].str(), ss[1].str() };
+	return { ss[0].str(), ss[1].str(), ss[2].str() };
 }
 
 GLuint Shader::CompileShader(const std::string& source, GLenum type)
@@ -103,7 +153,7 @@ GLuint Shader::CompileShader(const std::string& source, GLenum type)
 		glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
 		char* message = (char*)alloca(length * sizeof(char));
 		glGetShaderInfoLog(id, length, &length, message);
-		std::cout << "Failed to compile " << (type == GL_VERTEX_SHADER ? "vertex" : "fragment") << " shader!" << std::endl;
+		std::cout << "Failed to compile " << (type == GL_VERTEX_SHADER ? "vertex" : type == GL_FRAGMENT_SHADER ? "fragment" : "compute") << " shader!" << std::endl;
 		std::cout << message << std::endl;
 		glDeleteShader(id);
 
@@ -130,17 +180,75 @@ GLuint Shader::CreateShader(const std::string& vertexShader, const std::string&
 	return program;
 }
 
-GLint Shader::GetUniformLocation(const std::string& name)
+GLuint Shader::CreateComputeShader(const std::string& computeShader)
 {
-	auto it = m_UniformLocationCache.find(name);
-	if ( it != m_UniformLocationCache.end())
-		return it->second;
+	GLuint program = glCreateProgram();
+	GLuint cs = CompileShader(computeShader, GL_COMPUTE_SHADER);
+
+	GLCall(glAttachShader(program, cs));
+	GLCall(glLinkProgram(program));
+	GLCall(glValidateProgram(program));
+
+	glDeleteShader(cs);
+
+	return program;
+}
 
-	GLCall(GLint location = glGetUniformLocation(m_RendererID, name.c_str()));
+void Shader::ReflectUniforms()
+{
+	GLint count = 0;
+	GLCall(glGetProgramInterfaceiv(m_RendererID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count));
 
-	if (location == -1)
+	const GLenum properties[] = { GL_NAME_LENGTH, GL_LOCATION, GL_TYPE, GL_BLOCK_INDEX };
+	std::string name;
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint values[4];
+		GLCall(glGetProgramResourceiv(m_RendererID, GL_UNIFORM, i, 4, properties, 4, nullptr, values));
+		// block members are set through their buffers
+		if (values[3] != -1)
+			continue;
+
+		name.resize(values[0]);
+		GLCall(glGetProgramResourceName(m_RendererID, GL_UNIFORM, i, values[0], nullptr, name.data()));
+		name.resize(strlen(name.c_str()));
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			name.resize(name.size() - 3);
+
+		m_Uniforms.push_back({ name, values[1], (GLenum)values[2] });
+	}
+}
+
+// bools and samplers are set as ints
+static bool IsSetAsInt(GLenum type)
+{
+	switch (type)
+	{
+	case GL_INT:
+	case GL_BOOL:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_CUBE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+GLint Shader::FindUniform(const char* name, GLenum type) const
+{
+	auto it = std::find_if(m_Uniforms.begin(), m_Uniforms.end(), [name](const UniformInfo& uniform) { return uniform.name == name; });
+	if (it == m_Uniforms.end())
+	{
 		std::cout << "(Warning) Uniform " << name << " doesn't exist" << std::endl;
+		return -1;
+	}
 
-	m_UniformLocationCache[name] = location;
-	return location;
+	if (it->type != type && !(type == GL_INT && IsSetAsInt(it->type)))
+	{
+		std::cout << "(Warning) Uniform " << name << " in " << m_FilePath << " has a different type" << std::endl;
+		return -1;
+	}
+	return it->location;
 }
@@ -1,6 +1,6 @@
 #pragma once
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include <glad.h>
 #include <glm/glm.hpp>
 
@@ -8,14 +8,40 @@ struct ShaderSource
 {
 	std::string VertexSource;
 	std::string FragmentSource;
+	std::string ComputeSource;
+};
+
+// GL type a Uniform<T> has to be declared with (bools and samplers are set as int too)
+template<typename T> struct UniformType;
+template<> struct UniformType<int> { static constexpr GLenum Value = GL_INT; };
+template<> struct UniformType<unsigned int> { static constexpr GLenum Value = GL_UNSIGNED_INT; };
+template<> struct UniformType<float> { static constexpr GLenum Value = GL_FLOAT; };
+template<> struct UniformType<glm::vec3> { static constexpr GLenum Value = GL_FLOAT_VEC3; };
+template<> struct UniformType<glm::vec4> { static constexpr GLenum Value = GL_FLOAT_VEC4; };
+template<> struct UniformType<glm::mat4> { static constexpr GLenum Value = GL_FLOAT_MAT4; };
+
+// A uniform of type T in one program, resolved once through Shader::GetUniform. Setting it is a GL call
+// on the location, -1 (not in the program or optimized out) is ignored by GL like before
+template<typename T>
+struct Uniform
+{
+	GLint location = -1;
 };
 
 class Shader
 {
 private:
+	// active uniforms outside blocks, reflected after linking
+	struct UniformInfo
+	{
+		std::string name; // without the [0] of arrays
+		GLint location;
+		GLenum type;
+	};
+
 	std::string m_FilePath;
 	
-	std::unordered_map<std::string, GLint> m_UniformLocationCache;
+	std::vector<UniformInfo> m_Uniforms;
 
 public:
 	Shader(const std::string& filepath);
@@ -26,18 +52,37 @@ public:
 	void Bind() const;
 	void Unbind() const;
 
-	// Set uniforms
-	void SetUniform1i(const std::string& name, int value);
-	void SetUniform1f(const std::string& name, float value);
-	void SetUniform3f(const std::string& name, const glm::vec3& vec3);
-	void SetUniform4f(const std::string& name, const glm::vec4& vec4);
+	// Compute programs only, groups are dispatched on the bound program
+	void Dispatch(GLuint groupsX, GLuint groupsY = 1, GLuint groupsZ = 1) const;
+
+	// Looks name up in the reflected uniforms and checks its type, warns and returns a -1 handle if either is off
+	template<typename T>
+	inline Uniform<T> GetUniform(const char* name) const { return { FindUniform(name, UniformType<T>::Value) }; }
+
+	// Set uniforms of this program through handles, bound or not (so draws can be queued with them set),
+	// nothing is looked up
+	void SetUniform(Uniform<int> uniform, int value) const;
+	void SetUniform(Uniform<unsigned int> uniform, unsigned int value) const;
+	void SetUniform(Uniform<float> uniform, float value) const;
+	void SetUniform(Uniform<glm::vec3> uniform, const glm::vec3& value) const;
+	void SetUniform(Uniform<glm::vec4> uniform, const glm::vec4& value) const;
+	void SetUniform(Uniform<glm::mat4> uniform, const glm::mat4& value) const;
+
+	// By name, for one-off setup: every call looks the name up
+	void SetUniform1i(const char* name, int value) const;
+	void SetUniform1ui(const char* name, unsigned int value) const;
+	void SetUniform1f(const char* name, float value) const;
+	void SetUniform3f(const char* name, const glm::vec3& vec3) const;
+	void SetUniform4f(const char* name, const glm::vec4& vec4) const;
 	
-	void SetUniformMat4f(const std::string& name, const glm::mat4& mat);
+	void SetUniformMat4f(const char* name, const glm::mat4& mat) const;
 
 private:
 	ShaderSource ParseShader(const std::string& filepath);
 	GLuint CompileShader(const std::string& source, GLenum type);
 	GLuint CreateShader(const std::string& vertexShader, const std::string& fragmentShader);
+	GLuint CreateComputeShader(const std::string& computeShader);
 
-	GLint GetUniformLocation(const std::string& name);
+	void ReflectUniforms();
+	GLint FindUniform(const char* name, GLenum type) const;
 };
\ No newline at end of file
@@ -0,0 +1,313 @@
+#include "Simulation.h"
+#include "Cubes.h"
+#include "TransformKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static void RotateAround2D(glm::vec2 inPos, float inRadius, float inAngle, glm::vec2& outPos)
+{
+	outPos.x = ((cos(inAngle) * inRadius) + inPos.x);
+	outPos.y = ((sin(inAngle) * inRadius) + inPos.y);
+}
+
+// turns the orientation and the basis vectors around axis, which is taken before any of them change
+static void Turn(CameraState& camera, glm::vec3 axis, float radians)
+{
+	float s = sin(radians / 2);
+	glm::quat q = glm::quat(cos(radians / 2), axis.x * s, axis.y * s, axis.z * s);
+	camera.orientation *= q;
+	camera.forward = camera.forward * q;
+	camera.up = camera.up * q;
+	camera.left = camera.left * q;
+}
+
+void CameraState::Reset(glm::vec3 position, float pitch)
+{
+	orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	forward = glm::vec3(0.0f, 0.0f, -1.0f);
+	up = glm::vec3(0.0f, 1.0f, 0.0f);
+	left = glm::vec3(-1.0f, 0.0f, 0.0f);
+	this->position = position;
+	this->pitch = pitch;
+	yaw = 0.0f;
+	roll = 0.0f;
+	fov = 45.0f;
+}
+
+glm::mat4 CameraState::GetViewMatrix() const
+{
+	return glm::mat4_cast(orientation) * glm::translate(glm::mat4(1.0f), -position);
+}
+
+void SimulatedInstances::Add(InstanceHandle handle, const InstanceStore::Transform& transform, uint8_t instanceFlags)
+{
+	if (handle >= indices.size())
+		indices.resize(handle + 1, NoIndex);
+	indices[handle] = (uint32_t)handles.size();
+
+	handles.push_back(handle);
+	positions.push_back(transform.position);
+	scales.push_back(transform.scale);
+	rotations.push_back(transform.rotation);
+	flags.push_back(instanceFlags);
+	matrices.push_back(Cubes::MakeMatrix(transform.position, transform.scale, transform.rotation));
+}
+
+template<typename T>
+static void MoveAndPop(std::vector<T>& data, uint32_t to)
+{
+	data[to] = data.back();
+	data.pop_back();
+}
+
+// same swap with the last one as InstanceStore::Remove
+void SimulatedInstances::Remove(InstanceHandle handle)
+{
+	uint32_t index = indices[handle];
+	indices[handles.back()] = index;
+	indices[handle] = NoIndex;
+
+	MoveAndPop(handles, index);
+	MoveAndPop(positions, index);
+	MoveAndPop(scales, index);
+	MoveAndPop(rotations, index);
+	MoveAndPop(flags, index);
+	MoveAndPop(matrices, index);
+}
+
+void SimulatedInstances::SetTransform(InstanceHandle handle, const InstanceStore::Transform& transform)
+{
+	uint32_t index = indices[handle];
+	positions[index] = transform.position;
+	scales[index] = transform.scale;
+	rotations[index] = transform.rotation;
+	matrices[index] = Cubes::MakeMatrix(transform.position, transform.scale, transform.rotation);
+}
+
+void SimulatedInstances::SetFlags(InstanceHandle handle, uint8_t instanceFlags)
+{
+	flags[indices[handle]] = instanceFlags;
+}
+
+Simulation::Simulation(float tickRate)
+	: m_TickSeconds(1.0f / tickRate), m_Quit(false), m_PostedWorldEdits(0), m_Tick(0), m_WorldEdits(0), m_DeltaTick(0), m_AcknowledgedTick(0)
+{
+}
+
+Simulation::~Simulation()
+{
+	Stop();
+}
+
+void Simulation::Start()
+{
+	Tick();
+
+	m_Quit = false;
+	m_Thread = std::thread(&Simulation::ThreadLoop, this);
+}
+
+void Simulation::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_Wake.notify_all();
+
+	if (m_Thread.joinable())
+		m_Thread.join();
+}
+
+void Simulation::Post(Command command)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Commands.push_back({ std::move(command), false });
+}
+
+void Simulation::PostWorldEdit(Command command)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Commands.push_back({ std::move(command), true });
+	m_PostedWorldEdits++;
+}
+
+void Simulation::SetInput(const SimulationInput& input)
+{
+	// keys are held states, mouse motion adds up over the frames between two ticks
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	glm::vec2 mouseDelta = m_Input.mouseDelta + input.mouseDelta;
+	float wheel = m_Input.wheel + input.wheel;
+	m_Input = input;
+	m_Input.mouseDelta = mouseDelta;
+	m_Input.wheel = wheel;
+}
+
+void Simulation::ThreadLoop()
+{
+	auto tick = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(m_TickSeconds));
+	auto next = std::chrono::steady_clock::now();
+
+	while (true)
+	{
+		next += tick;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			if (m_Wake.wait_until(lock, next, [this] { return m_Quit; }))
+				return;
+		}
+
+		Tick();
+
+		// after a long stall skip the missed ticks instead of running them back to back
+		auto now = std::chrono::steady_clock::now();
+		if (now > next + tick)
+			next = now;
+	}
+}
+
+void Simulation::Tick()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	SimulationInput input;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Executing.swap(m_Commands);
+		input = m_Input;
+		m_Input.mouseDelta = glm::vec2(0.0f);
+		m_Input.wheel = 0.0f;
+	}
+	for (PostedCommand& posted : m_Executing)
+	{
+		posted.command(m_State);
+		m_WorldEdits += posted.worldEdit;
+	}
+	m_Executing.clear();
+
+	m_Tick++;
+	StepCamera(input);
+	StepLight();
+	StepSpin();
+
+	FrameSnapshot& snapshot = m_Mailbox.GetBack();
+	snapshot.tick = m_Tick;
+	snapshot.worldEdits = m_WorldEdits;
+	snapshot.camera = m_State.camera;
+	snapshot.view = m_State.camera.GetViewMatrix();
+	snapshot.light = m_State.light;
+	snapshot.spin = m_State.spin;
+
+	// the full set every time, so a dropped or rejected snapshot loses nothing
+	const SimulatedInstances& instances = m_State.instances;
+	if (m_DeltaTick > m_AcknowledgedTick.load(std::memory_order_acquire))
+	{
+		snapshot.deltaHandles.assign(instances.handles.begin(), instances.handles.end());
+		snapshot.deltaRotations.assign(instances.rotations.begin(), instances.rotations.end());
+		snapshot.deltaMatrices.assign(instances.matrices.begin(), instances.matrices.end());
+	}
+	else
+	{
+		snapshot.deltaHandles.clear();
+		snapshot.deltaRotations.clear();
+		snapshot.deltaMatrices.clear();
+	}
+
+	snapshot.tickMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	m_Mailbox.Publish();
+}
+
+void Simulation::StepCamera(const SimulationInput& input)
+{
+	CameraState& camera = m_State.camera;
+
+	if (input.forward)
+		camera.position += camera.speed * camera.forward;
+	if (input.back)
+		camera.position -= camera.speed * camera.forward;
+	if (input.left)
+		camera.position -= camera.speed * glm::normalize(glm::cross(camera.forward, camera.up));
+	if (input.right)
+		camera.position += camera.speed * glm::normalize(glm::cross(camera.forward, camera.up));
+	if (input.rollLeft)
+		camera.roll += camera.speed;
+	if (input.rollRight)
+		camera.roll -= camera.speed;
+
+	if (input.mouseLook)
+	{
+		camera.yaw += input.mouseDelta.x;
+		camera.pitch = std::clamp(camera.pitch - input.mouseDelta.y, -89.0f, 89.0f);
+		camera.fov = std::clamp(camera.fov - 2 * input.wheel, 1.0f, 90.0f);
+	}
+
+	// absolute angles are applied to a fresh basis, flight mode keeps turning the current one
+	if (!camera.flightMode)
+	{
+		camera.orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		camera.forward = glm::vec3(0.0f, 0.0f, -1.0f);
+		camera.up = glm::vec3(0.0f, 1.0f, 0.0f);
+		camera.left = glm::vec3(-1.0f, 0.0f, 0.0f);
+	}
+
+	Turn(camera, camera.forward, glm::radians(camera.roll));
+	Turn(camera, camera.left, glm::radians(camera.pitch));
+	Turn(camera, camera.up, glm::radians(camera.yaw));
+
+	if (camera.flightMode)
+	{
+		camera.roll = 0.0f;
+		camera.pitch = 0.0f;
+		camera.yaw = 0.0f;
+	}
+}
+
+void Simulation::StepLight()
+{
+	LightState& light = m_State.light;
+
+	if (light.angle > 360.0f)
+		light.angle = 0.0f;
+	if (light.angle < 0.0f)
+		light.angle = 360.0f;
+
+	if (!light.paused)
+		light.angle += light.reverse ? -(m_TickSeconds + light.speed) : m_TickSeconds + light.speed;
+
+	glm::vec3 center = light.center;
+	glm::vec2 position;
+	switch (light.plane)
+	{
+	case OrbitPlane::XY:
+		RotateAround2D(glm::vec2(center.x, center.y), light.radius, glm::radians(light.angle), position);
+		light.position = glm::vec3(position.x, position.y, center.z);
+		break;
+	case OrbitPlane::XZ:
+		RotateAround2D(glm::vec2(center.x, center.z), light.radius, glm::radians(light.angle), position);
+		light.position = glm::vec3(position.x, center.y, position.y);
+		break;
+	case OrbitPlane::YZ:
+		RotateAround2D(glm::vec2(center.y, center.z), light.radius, glm::radians(light.angle), position);
+		light.position = glm::vec3(center.x, position.x, position.y);
+		break;
+	}
+}
+
+void Simulation::StepSpin()
+{
+	if (!m_State.spin.enabled)
+		return;
+
+	// the occluders (ground, big box) stay put
+	SimulatedInstances& instances = m_State.instances;
+	float angle = m_State.spin.speed * m_TickSeconds;
+	for (size_t i = 0; i < instances.Size(); i++)
+		if (!(instances.flags[i] & InstanceFlag_Occluder))
+			instances.rotations[i].z += angle;
+
+	// on this thread alone, the job system belongs to the render thread's frame
+	GetTransformKernel()(instances.positions.data(), instances.scales.data(), instances.rotations.data(), instances.matrices.data(), instances.Size());
+	m_DeltaTick = m_Tick;
+}
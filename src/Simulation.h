@@ -0,0 +1,178 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FrameMailbox.h"
+#include "InstanceStore.h"
+
+// Free camera. In flight mode pitch/yaw/roll are turned per tick and reset, otherwise they're absolute angles
+struct CameraState
+{
+	glm::vec3 position = glm::vec3(50.0f, -40.0f, 60.0f);
+	float pitch = 46.0f, yaw = 0.0f, roll = 0.0f, fov = 45.0f;
+	float speed = 10.0f;
+	bool flightMode = true;
+
+	glm::vec3 forward = glm::vec3(0.0f, 0.0f, -1.0f), up = glm::vec3(0.0f, 1.0f, 0.0f), left = glm::vec3(-1.0f, 0.0f, 0.0f);
+	glm::quat orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+
+	void Reset(glm::vec3 position, float pitch);
+	glm::mat4 GetViewMatrix() const;
+};
+
+enum class OrbitPlane
+{
+	XY,
+	XZ,
+	YZ
+};
+
+// Point light circling center, angle in degrees, speed in degrees per tick
+struct LightState
+{
+	glm::vec3 center = glm::vec3(50.0f, 50.0f, 2.0f);
+	glm::vec3 position = glm::vec3(50.0f, 50.0f, 5.0f);
+	float angle = 0.0f, radius = 10.0f, speed = 1.0f;
+	OrbitPlane plane = OrbitPlane::XY;
+	bool paused = false, reverse = false;
+};
+
+// Every instance that isn't an occluder turns around z
+struct SpinState
+{
+	bool enabled = false;
+	float speed = 1.0f; // radians per second
+};
+
+// The simulation's copy of the instance transforms, by InstanceStore handle. Kept in step with the
+// store through world edit commands, the store itself belongs to the render thread
+struct SimulatedInstances
+{
+	static constexpr uint32_t NoIndex = ~0u;
+
+	std::vector<InstanceHandle> handles;
+	std::vector<glm::vec3> positions, scales, rotations;
+	std::vector<uint8_t> flags;
+	std::vector<glm::mat4> matrices;
+	std::vector<uint32_t> indices; // handle -> index above, NoIndex when not tracked
+
+	void Add(InstanceHandle handle, const InstanceStore::Transform& transform, uint8_t flags);
+	void Remove(InstanceHandle handle);
+	void SetTransform(InstanceHandle handle, const InstanceStore::Transform& transform);
+	void SetFlags(InstanceHandle handle, uint8_t flags);
+	inline size_t Size() const { return handles.size(); }
+};
+
+// Everything the simulation thread owns, commands posted from the render thread run against it
+struct SimulationState
+{
+	CameraState camera;
+	LightState light;
+	SpinState spin;
+	SimulatedInstances instances;
+};
+
+// Held keys and mouse motion, sent by the render thread since it owns the window
+struct SimulationInput
+{
+	bool forward = false, back = false, left = false, right = false, rollLeft = false, rollRight = false;
+	bool mouseLook = false;
+	glm::vec2 mouseDelta = glm::vec2(0.0f); // summed until the next tick
+	float wheel = 0.0f;
+};
+
+// One tick's results, immutable once published
+struct FrameSnapshot
+{
+	uint64_t tick = 0;
+	// world edits this tick had applied, its instance deltas only match a store with exactly those edits
+	uint64_t worldEdits = 0;
+	float tickMs = 0.0f;
+
+	CameraState camera;
+	glm::mat4 view = glm::mat4(1.0f);
+	LightState light;
+	SpinState spin;
+
+	// instances whose rotation the simulation changed since the render thread last acknowledged, with their new matrices
+	std::vector<InstanceHandle> deltaHandles;
+	std::vector<glm::vec3> deltaRotations;
+	std::vector<glm::mat4> deltaMatrices;
+};
+
+// Runs camera, light orbit and cube spin on its own thread at a fixed rate and publishes a FrameSnapshot
+// per tick into a triple buffered mailbox. The render thread keeps the GL context, draws the latest
+// snapshot and talks back through commands, so a slow tick delays the next snapshot instead of a frame.
+class Simulation
+{
+public:
+	typedef std::function<void(SimulationState& state)> Command;
+
+private:
+	struct PostedCommand
+	{
+		Command command;
+		bool worldEdit;
+	};
+
+	float m_TickSeconds;
+	SimulationState m_State;
+	FrameMailbox<FrameSnapshot> m_Mailbox;
+
+	// render thread -> simulation
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	std::vector<PostedCommand> m_Commands;
+	SimulationInput m_Input;
+	bool m_Quit;
+	uint64_t m_PostedWorldEdits; // render thread only
+
+	// simulation thread only
+	std::vector<PostedCommand> m_Executing;
+	uint64_t m_Tick;
+	uint64_t m_WorldEdits;
+	// last tick that changed instances, they're sent again until the render thread acknowledges a tick at or past it
+	uint64_t m_DeltaTick;
+	std::atomic<uint64_t> m_AcknowledgedTick;
+
+	std::thread m_Thread;
+
+public:
+	explicit Simulation(float tickRate);
+	~Simulation();
+
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	// Runs the first tick on the calling thread, so a snapshot is ready, then starts the thread
+	void Start();
+	void Stop();
+
+	// Render thread side. Commands run at the start of the next tick, in order
+	void Post(Command command);
+	// For commands that change which instances exist or where they are, see FrameSnapshot::worldEdits
+	void PostWorldEdit(Command command);
+	inline uint64_t GetPostedWorldEdits() const { return m_PostedWorldEdits; }
+	void SetInput(const SimulationInput& input);
+
+	// Swaps in the latest snapshot, false when there's nothing new since the last call
+	inline bool Acquire() { return m_Mailbox.Acquire(); }
+	inline const FrameSnapshot& GetSnapshot() const { return m_Mailbox.GetFront(); }
+	// The snapshot's deltas made it into the InstanceStore
+	inline void Acknowledge(uint64_t tick) { m_AcknowledgedTick.store(tick, std::memory_order_release); }
+
+private:
+	void ThreadLoop();
+	void Tick();
+	void StepCamera(const SimulationInput& input);
+	void StepLight();
+	void StepSpin();
+};
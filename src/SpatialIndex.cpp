@@ -0,0 +1,71 @@
+#include "SpatialIndex.h"
+
+#include <chrono>
+
+SpatialIndex::SpatialIndex(JobSystem& jobs, glm::vec2 origin, float cellSize, int columns, int rows)
+	: m_Jobs(jobs), m_Grid(origin, cellSize, columns, rows), m_LayoutVersion(0), m_Built(false), m_Rebuilt(false), m_UpdateMs(0.0f)
+{
+}
+
+void SpatialIndex::Update(InstanceStore& instances)
+{
+	instances.TakeMovedBounds(m_Moved);
+	bool relayout = !m_Built || instances.GetLayoutVersion() != m_LayoutVersion;
+	if (!relayout && m_Moved.Empty())
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// the grid rebuilds in O(n) either way, the BVH keeps its tree as long as the indices mean the same
+	m_Grid.Build(instances.GetBounds(), m_Jobs);
+	if (relayout)
+		m_Bvh.Build(instances.GetBounds(), m_Jobs);
+	else
+		m_Bvh.Refit(m_Moved);
+
+	m_LayoutVersion = instances.GetLayoutVersion();
+	m_Built = true;
+	m_Rebuilt = relayout;
+	m_UpdateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool SpatialIndex::Raycast(const InstanceStore& instances, glm::vec3 origin, glm::vec3 direction, float maxDistance, Bvh::RayHit& hit) const
+{
+	const std::vector<glm::mat4>& matrices = instances.GetMatrices();
+	static const Aabb UnitCube(glm::vec3(-0.5f), glm::vec3(0.5f));
+
+	// into the cube's space, where it's the unit box. The direction isn't renormalized, so distances carry over.
+	// Model matrices are affine, inverting the 3x3 part is enough
+	auto hitTest = [&](uint32_t index, glm::vec3 rayOrigin, glm::vec3 rayDirection, float rayMax)
+	{
+		glm::mat3 inverse = glm::inverse(glm::mat3(matrices[index]));
+		glm::vec3 localOrigin = inverse * (rayOrigin - glm::vec3(matrices[index][3]));
+		glm::vec3 localDirection = inverse * rayDirection;
+		return UnitCube.Intersect(localOrigin, 1.0f / localDirection, rayMax);
+	};
+
+	return m_Bvh.Raycast(origin, direction, maxDistance, hitTest, hit);
+}
+
+bool SpatialIndex::Pick(const InstanceStore& instances, glm::vec2 pixel, glm::vec2 viewport, const glm::mat4& projection, const glm::mat4& view, PickHit& hit) const
+{
+	hit = PickHit();
+
+	// unproject the pixel on the near and far planes, the ray runs between them
+	glm::vec2 ndc(2.0f * pixel.x / viewport.x - 1.0f, 1.0f - 2.0f * pixel.y / viewport.y);
+	glm::mat4 inverse = glm::inverse(projection * view);
+	glm::vec4 nearPoint = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 toFar = glm::vec3(farPoint) / farPoint.w - origin;
+	float length = glm::length(toFar);
+
+	Bvh::RayHit rayHit;
+	if (!Raycast(instances, origin, toFar / length, length, rayHit))
+		return false;
+
+	hit.index = rayHit.index;
+	hit.handle = instances.GetHandle(rayHit.index);
+	hit.distance = rayHit.distance;
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.h"
+#include "UniformGrid.h"
+#include "InstanceStore.h"
+#include "JobSystem.h"
+
+// What's under a screen position
+struct PickHit
+{
+	InstanceHandle handle = 0;
+	uint32_t index = ~0u; // dense store index, ~0u on a miss
+	float distance = FLT_MAX; // world units along the ray from the near plane
+};
+
+// World queries (what's near a point, in a region, under a ray) without scanning every instance.
+// Keeps a UniformGrid over the playfield and a Bvh over everything in step with an InstanceStore:
+// adds and removes rebuild both, moves refit the BVH and rebuild the grid. Results are dense store indices.
+class SpatialIndex
+{
+private:
+	JobSystem& m_Jobs;
+	UniformGrid m_Grid;
+	Bvh m_Bvh;
+
+	uint64_t m_LayoutVersion;
+	bool m_Built;
+	DirtyRanges m_Moved;
+
+	bool m_Rebuilt;
+	float m_UpdateMs;
+
+public:
+	// Grid of columns x rows cells of cellSize, starting at origin on x/y
+	SpatialIndex(JobSystem& jobs, glm::vec2 origin, float cellSize, int columns, int rows);
+
+	// Before querying, whenever the store may have changed
+	void Update(InstanceStore& instances);
+
+	// Closest cube the ray hits, tested exactly against its rotated and scaled box
+	bool Raycast(const InstanceStore& instances, glm::vec3 origin, glm::vec3 direction, float maxDistance, Bvh::RayHit& hit) const;
+	// Raycast from the camera through pixel (top left origin) of a viewport drawn with projection * view
+	bool Pick(const InstanceStore& instances, glm::vec2 pixel, glm::vec2 viewport, const glm::mat4& projection, const glm::mat4& view, PickHit& hit) const;
+
+	inline const UniformGrid& GetGrid() const { return m_Grid; }
+	inline const Bvh& GetBvh() const { return m_Bvh; }
+	// whether the last Update rebuilt (true) or only refit, and how long it took
+	inline bool WasRebuilt() const { return m_Rebuilt; }
+	inline float GetUpdateMs() const { return m_UpdateMs; }
+};
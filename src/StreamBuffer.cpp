@@ -0,0 +1,95 @@
+#include "StreamBuffer.h"
+#include "GLState.h"
+#include "renderer.h"
+
+#include <iostream>
+
+StreamBuffer::StreamBuffer(GLenum target, GLuint binding, GLsizeiptr regionSize)
+	: m_RendererID(0), m_Target(target), m_Binding(binding), m_RegionSize(0), m_MappedData(nullptr), m_Fences(), m_CurrentRegion(0)
+{
+	Resize(regionSize);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	Release();
+}
+
+void* StreamBuffer::BeginWrite()
+{
+	GLsync& fence = m_Fences[m_CurrentRegion];
+	if (fence)
+	{
+		// only blocks when the CPU is RegionCount frames ahead of the GPU
+		GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+		GLCall(glDeleteSync(fence));
+		fence = nullptr;
+	}
+
+	return m_MappedData + m_CurrentRegion * m_RegionSize;
+}
+
+void StreamBuffer::EndWrite() const
+{
+	GLState::BindBufferRange(m_Target, m_Binding, m_RendererID, m_CurrentRegion * m_RegionSize, m_RegionSize);
+}
+
+void StreamBuffer::Lock()
+{
+	GLCall(m_Fences[m_CurrentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+	m_CurrentRegion = (m_CurrentRegion + 1) % RegionCount;
+}
+
+void StreamBuffer::Resize(GLsizeiptr regionSize)
+{
+	// regions are bound with glBindBufferRange, their offsets have to respect the target's alignment
+	GLint alignment = 256;
+	if (m_Target == GL_SHADER_STORAGE_BUFFER)
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	else if (m_Target == GL_UNIFORM_BUFFER)
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+	Release();
+	m_RegionSize = ((regionSize + alignment - 1) / alignment) * alignment;
+	Create();
+}
+
+void StreamBuffer::Create()
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	GLCall(glGenBuffers(1, &m_RendererID));
+	GLState::BindBuffer(m_Target, m_RendererID);
+	GLCall(glBufferStorage(m_Target, m_RegionSize * RegionCount, nullptr, flags));
+	GLCall(m_MappedData = (GLubyte*)glMapBufferRange(m_Target, 0, m_RegionSize * RegionCount, flags));
+
+	if (!m_MappedData)
+		std::cout << "(Warning) StreamBuffer failed to map " << m_RegionSize * RegionCount << " bytes" << std::endl;
+
+	m_CurrentRegion = 0;
+}
+
+void StreamBuffer::Release()
+{
+	for (GLsync& fence : m_Fences)
+	{
+		if (fence)
+		{
+			GLCall(glDeleteSync(fence));
+		}
+		fence = nullptr;
+	}
+
+	if (!m_RendererID)
+		return;
+
+	// deleting a buffer the GPU still reads from is fine, GL defers it until the reads are done
+	GLState::BindBuffer(m_Target, m_RendererID);
+	GLCall(glUnmapBuffer(m_Target));
+	GLState::DeleteBuffer(m_RendererID);
+	m_RendererID = 0;
+	m_MappedData = nullptr;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <glad.h>
+
+// Persistently mapped buffer split into RegionCount regions. Each frame writes the next region
+// while the GPU may still be reading the previous ones, a fence per region guards reuse.
+class StreamBuffer
+{
+public:
+	static constexpr int RegionCount = 3;
+
+private:
+	GLuint m_RendererID;
+	GLenum m_Target;
+	GLuint m_Binding;
+
+	GLsizeiptr m_RegionSize;
+	GLubyte* m_MappedData;
+
+	GLsync m_Fences[RegionCount];
+	int m_CurrentRegion;
+
+public:
+	StreamBuffer(GLenum target, GLuint binding, GLsizeiptr regionSize);
+	~StreamBuffer();
+
+	// Waits until the GPU is done with the current region and returns its mapped memory
+	void* BeginWrite();
+	// Binds the current region to the binding point
+	void EndWrite() const;
+	// Fences the current region after the draw that reads it, then moves to the next region
+	void Lock();
+
+	// Reallocates storage, contents are lost
+	void Resize(GLsizeiptr regionSize);
+
+	inline GLuint GetRendererID() const { return m_RendererID; }
+	inline GLsizeiptr GetRegionSize() const { return m_RegionSize; }
+	inline GLintptr GetRegionOffset() const { return m_CurrentRegion * m_RegionSize; }
+	inline int GetCurrentRegion() const { return m_CurrentRegion; }
+
+private:
+	void Create();
+	void Release();
+};
@@ -1,4 +1,5 @@
 #include "Texture.h"
+#include "GLState.h"
 
 #include "vendor/stb_image/stb_image.h"
 
@@ -9,7 +10,7 @@ Texture::Texture(const std::string& path) : m_RendererID(0), m_Filepath(path), m
 
 
 	GLCall(glGenTextures(1, &m_RendererID));
-	GLCall(glBindTexture(GL_TEXTURE_2D, m_RendererID));
+	GLState::BindTexture(0, m_RendererID);
 
 	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
 	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
@@ -17,7 +18,7 @@ Texture::Texture(const std::string& path) : m_RendererID(0), m_Filepath(path), m
 	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
 
 	GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_Width, m_Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_LocalBuffer));
-	GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+	GLState::BindTexture(0, 0);
 
 	if (m_LocalBuffer)
 		stbi_image_free(m_LocalBuffer);
@@ -25,16 +26,15 @@ Texture::Texture(const std::string& path) : m_RendererID(0), m_Filepath(path), m
 
 Texture::~Texture()
 {
-	GLCall(glDeleteTextures(1, &m_RendererID));
+	GLState::DeleteTexture(m_RendererID);
 }
 
 void Texture::Bind(GLuint slot) const
 {
-	GLCall(glActiveTexture(GL_TEXTURE0 + slot));
-	GLCall(glBindTexture(GL_TEXTURE_2D, m_RendererID));
+	GLState::BindTexture(slot, m_RendererID);
 }
 
-void Texture::Unbind() const
+void Texture::Unbind(GLuint slot) const
 {
-	GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+	GLState::BindTexture(slot, 0);
 }
@@ -15,7 +15,7 @@ public:
 	~Texture();
 
 	void Bind(GLuint slot = 0) const;
-	void Unbind() const;
+	void Unbind(GLuint slot = 0) const;
 
 	inline int GetWidth() const { return m_Width; }
 	inline int GetHeight() const { return m_Height; }
@@ -0,0 +1,255 @@
+#include "TransformKernels.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Rx(a) * Ry(b) * Rz(c) multiplied out, columns scaled. Returned column major like glm::mat4
+static inline glm::mat4 ComposeMatrix(glm::vec3 position, glm::vec3 scale, glm::vec3 sine, glm::vec3 cosine)
+{
+	float sa = sine.x, ca = cosine.x, sb = sine.y, cb = cosine.y, sc = sine.z, cc = cosine.z;
+
+	return glm::mat4(
+		glm::vec4(cb * cc, sa * sb * cc + ca * sc, sa * sc - ca * sb * cc, 0.0f) * scale.x,
+		glm::vec4(-cb * sc, ca * cc - sa * sb * sc, ca * sb * sc + sa * cc, 0.0f) * scale.y,
+		glm::vec4(sb, -sa * cb, ca * cb, 0.0f) * scale.z,
+		glm::vec4(position, 1.0f));
+}
+
+void BuildMatricesScalar(const glm::vec3* positions, const glm::vec3* scales, const glm::vec3* rotations, glm::mat4* matrices, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 rotation = rotations[i];
+		glm::vec3 sine(std::sin(rotation.x), std::sin(rotation.y), std::sin(rotation.z));
+		glm::vec3 cosine(std::cos(rotation.x), std::cos(rotation.y), std::cos(rotation.z));
+		matrices[i] = ComposeMatrix(positions[i], scales[i], sine, cosine);
+	}
+}
+
+#ifdef SIMD_X86
+
+// sincos from Cephes (as in sse_mathfun): reduce to [-pi/4, pi/4] by octant, then one polynomial for
+// each and swap/negate by octant. Good to a couple of ulp for the angle range rotations use.
+static constexpr float FourOverPi = 1.27323954473516f;
+static constexpr float PiOver4Part1 = 0.78515625f;
+static constexpr float PiOver4Part2 = 2.4187564849853515625e-4f;
+static constexpr float PiOver4Part3 = 3.77489497744594108e-8f;
+
+static inline void SinCos4(__m128 x, __m128& sine, __m128& cosine)
+{
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+	__m128 sinSign = _mm_and_ps(x, signMask);
+	x = _mm_andnot_ps(signMask, x);
+
+	// octant, rounded up to even
+	__m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FourOverPi)));
+	octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	__m128 y = _mm_cvtepi32_ps(octant);
+
+	sinSign = _mm_xor_ps(sinSign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29)));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+	__m128 sinIsPoly = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PiOver4Part1)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PiOver4Part2)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PiOver4Part3)));
+	__m128 z = _mm_mul_ps(x, x);
+
+	__m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z), _mm_set1_ps(-1.388731625493765e-3f));
+	cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(4.166664568298827e-2f));
+	cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+	cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+	__m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z), _mm_set1_ps(8.3321608736e-3f));
+	sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(-1.6666654611e-1f));
+	sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+	sine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(sinIsPoly, sinPoly), _mm_andnot_ps(sinIsPoly, cosPoly)), sinSign);
+	cosine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(sinIsPoly, cosPoly), _mm_andnot_ps(sinIsPoly, sinPoly)), cosSign);
+}
+
+// one column of 4 consecutive matrices, lane i goes to matrix i
+static inline void StoreColumn4(float* column, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(column, x);
+	_mm_storeu_ps(column + 16, y);
+	_mm_storeu_ps(column + 32, z);
+	_mm_storeu_ps(column + 48, w);
+}
+
+static void BuildMatricesSSE(const glm::vec3* positions, const glm::vec3* scales, const glm::vec3* rotations, glm::mat4* matrices, size_t count)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const glm::vec3* r = rotations + i;
+		__m128 sa, ca, sb, cb, sc, cc;
+		SinCos4(_mm_setr_ps(r[0].x, r[1].x, r[2].x, r[3].x), sa, ca);
+		SinCos4(_mm_setr_ps(r[0].y, r[1].y, r[2].y, r[3].y), sb, cb);
+		SinCos4(_mm_setr_ps(r[0].z, r[1].z, r[2].z, r[3].z), sc, cc);
+
+		const glm::vec3* s = scales + i;
+		__m128 sx = _mm_setr_ps(s[0].x, s[1].x, s[2].x, s[3].x);
+		__m128 sy = _mm_setr_ps(s[0].y, s[1].y, s[2].y, s[3].y);
+		__m128 sz = _mm_setr_ps(s[0].z, s[1].z, s[2].z, s[3].z);
+
+		__m128 sasb = _mm_mul_ps(sa, sb);
+		__m128 casb = _mm_mul_ps(ca, sb);
+
+		float* out = &matrices[i][0][0];
+		StoreColumn4(out,
+			_mm_mul_ps(_mm_mul_ps(cb, cc), sx),
+			_mm_mul_ps(_mm_add_ps(_mm_mul_ps(sasb, cc), _mm_mul_ps(ca, sc)), sx),
+			_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(sa, sc), _mm_mul_ps(casb, cc)), sx),
+			zero);
+		StoreColumn4(out + 4,
+			_mm_mul_ps(_mm_sub_ps(zero, _mm_mul_ps(cb, sc)), sy),
+			_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(ca, cc), _mm_mul_ps(sasb, sc)), sy),
+			_mm_mul_ps(_mm_add_ps(_mm_mul_ps(casb, sc), _mm_mul_ps(sa, cc)), sy),
+			zero);
+		StoreColumn4(out + 8,
+			_mm_mul_ps(sb, sz),
+			_mm_mul_ps(_mm_sub_ps(zero, _mm_mul_ps(sa, cb)), sz),
+			_mm_mul_ps(_mm_mul_ps(ca, cb), sz),
+			zero);
+
+		const glm::vec3* p = positions + i;
+		StoreColumn4(out + 12,
+			_mm_setr_ps(p[0].x, p[1].x, p[2].x, p[3].x),
+			_mm_setr_ps(p[0].y, p[1].y, p[2].y, p[3].y),
+			_mm_setr_ps(p[0].z, p[1].z, p[2].z, p[3].z),
+			one);
+	}
+
+	BuildMatricesScalar(positions + i, scales + i, rotations + i, matrices + i, count - i);
+}
+
+TARGET_AVX2
+static inline void SinCos8(__m256 x, __m256& sine, __m256& cosine)
+{
+	const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+	__m256 sinSign = _mm256_and_ps(x, signMask);
+	x = _mm256_andnot_ps(signMask, x);
+
+	__m256i octant = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FourOverPi)));
+	octant = _mm256_and_si256(_mm256_add_epi32(octant, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+	__m256 y = _mm256_cvtepi32_ps(octant);
+
+	sinSign = _mm256_xor_ps(sinSign, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(4)), 29)));
+	__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(octant, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+	__m256 sinIsPoly = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+
+	x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PiOver4Part1)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PiOver4Part2)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PiOver4Part3)));
+	__m256 z = _mm256_mul_ps(x, x);
+
+	__m256 cosPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.443315711809948e-5f), z), _mm256_set1_ps(-1.388731625493765e-3f));
+	cosPoly = _mm256_add_ps(_mm256_mul_ps(cosPoly, z), _mm256_set1_ps(4.166664568298827e-2f));
+	cosPoly = _mm256_mul_ps(_mm256_mul_ps(cosPoly, z), z);
+	cosPoly = _mm256_add_ps(_mm256_sub_ps(cosPoly, _mm256_mul_ps(z, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1.0f));
+
+	__m256 sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-1.9515295891e-4f), z), _mm256_set1_ps(8.3321608736e-3f));
+	sinPoly = _mm256_add_ps(_mm256_mul_ps(sinPoly, z), _mm256_set1_ps(-1.6666654611e-1f));
+	sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sinPoly, z), x), x);
+
+	sine = _mm256_xor_ps(_mm256_blendv_ps(cosPoly, sinPoly, sinIsPoly), sinSign);
+	cosine = _mm256_xor_ps(_mm256_blendv_ps(sinPoly, cosPoly, sinIsPoly), cosSign);
+}
+
+// one column of 8 consecutive matrices, as two 4x4 transposes
+TARGET_AVX2
+static inline void StoreColumn8(float* column, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+	StoreColumn4(column, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z), _mm256_castps256_ps128(w));
+	StoreColumn4(column + 64, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(w, 1));
+}
+
+TARGET_AVX2
+static inline __m256 Gather8(const glm::vec3* v, int component)
+{
+	return _mm256_setr_ps(v[0][component], v[1][component], v[2][component], v[3][component],
+		v[4][component], v[5][component], v[6][component], v[7][component]);
+}
+
+TARGET_AVX2
+static void BuildMatricesAVX2(const glm::vec3* positions, const glm::vec3* scales, const glm::vec3* rotations, glm::mat4* matrices, size_t count)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 sa, ca, sb, cb, sc, cc;
+		SinCos8(Gather8(rotations + i, 0), sa, ca);
+		SinCos8(Gather8(rotations + i, 1), sb, cb);
+		SinCos8(Gather8(rotations + i, 2), sc, cc);
+
+		__m256 sx = Gather8(scales + i, 0);
+		__m256 sy = Gather8(scales + i, 1);
+		__m256 sz = Gather8(scales + i, 2);
+
+		__m256 sasb = _mm256_mul_ps(sa, sb);
+		__m256 casb = _mm256_mul_ps(ca, sb);
+
+		float* out = &matrices[i][0][0];
+		StoreColumn8(out,
+			_mm256_mul_ps(_mm256_mul_ps(cb, cc), sx),
+			_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(sasb, cc), _mm256_mul_ps(ca, sc)), sx),
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(sa, sc), _mm256_mul_ps(casb, cc)), sx),
+			zero);
+		StoreColumn8(out + 4,
+			_mm256_mul_ps(_mm256_sub_ps(zero, _mm256_mul_ps(cb, sc)), sy),
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(ca, cc), _mm256_mul_ps(sasb, sc)), sy),
+			_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(casb, sc), _mm256_mul_ps(sa, cc)), sy),
+			zero);
+		StoreColumn8(out + 8,
+			_mm256_mul_ps(sb, sz),
+			_mm256_mul_ps(_mm256_sub_ps(zero, _mm256_mul_ps(sa, cb)), sz),
+			_mm256_mul_ps(_mm256_mul_ps(ca, cb), sz),
+			zero);
+		StoreColumn8(out + 12, Gather8(positions + i, 0), Gather8(positions + i, 1), Gather8(positions + i, 2), one);
+	}
+
+	BuildMatricesSSE(positions + i, scales + i, rotations + i, matrices + i, count - i);
+}
+
+#endif
+
+TransformKernel GetTransformKernel()
+{
+#ifdef SIMD_X86
+	return CpuHasAVX2() ? BuildMatricesAVX2 : BuildMatricesSSE;
+#else
+	return BuildMatricesScalar;
+#endif
+}
+
+const char* GetTransformKernelName()
+{
+#ifdef SIMD_X86
+	return CpuHasAVX2() ? "AVX2" : "SSE";
+#else
+	return "scalar";
+#endif
+}
+
+void BuildMatrices(JobSystem& jobs, const glm::vec3* positions, const glm::vec3* scales, const glm::vec3* rotations, glm::mat4* matrices, size_t count)
+{
+	TransformKernel kernel = GetTransformKernel();
+
+	// split in groups of 8 so only the last chunk has a tail
+	size_t groupCount = (count + 7) / 8;
+	jobs.ParallelFor(0, groupCount, ParallelTransformBatch / 8, [=](size_t firstGroup, size_t lastGroup)
+	{
+		size_t begin = firstGroup * 8;
+		size_t end = std::min(lastGroup * 8, count);
+		kernel(positions + begin, scales + begin, rotations + begin, matrices + begin, end - begin);
+	});
+}
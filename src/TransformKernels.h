@@ -0,0 +1,21 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+#include "JobSystem.h"
+
+// Batched model matrices, translate * rotateX * rotateY * rotateZ * scale like Cubes::MakeMatrix, but with
+// the rotation expanded in closed form (a sin/cos pair per axis instead of three rotate calls) and built
+// 4 (SSE) or 8 (AVX2) instances at a time.
+typedef void (*TransformKernel)(const glm::vec3* positions, const glm::vec3* scales, const glm::vec3* rotations, glm::mat4* matrices, size_t count);
+
+void BuildMatricesScalar(const glm::vec3* positions, const glm::vec3* scales, const glm::vec3* rotations, glm::mat4* matrices, size_t count);
+
+// The widest kernel this CPU runs, picked once
+TransformKernel GetTransformKernel();
+const char* GetTransformKernelName();
+
+// Batches over ParallelTransformBatch instances are split into jobs of at least that size
+constexpr size_t ParallelTransformBatch = 64 * 1024;
+void BuildMatrices(JobSystem& jobs, const glm::vec3* positions, const glm::vec3* scales, const glm::vec3* rotations, glm::mat4* matrices, size_t count);
@@ -0,0 +1,188 @@
+#include "UniformGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+UniformGrid::UniformGrid(glm::vec2 origin, float cellSize, int columns, int rows)
+	: m_Origin(origin), m_CellSize(cellSize), m_Columns(columns), m_Rows(rows), m_Bounds(nullptr), m_MaxRadius(0.0f)
+{
+}
+
+void UniformGrid::Build(const BoundingSpheres& bounds, JobSystem& jobs)
+{
+	m_Bounds = &bounds;
+	size_t count = bounds.Size();
+	size_t cellCount = (size_t)m_Columns * m_Rows;
+
+	m_CellOf.resize(count);
+	jobs.ParallelFor(0, count, 64 * 1024, [this, &bounds](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			int column = (int)std::floor((bounds.x[i] - m_Origin.x) / m_CellSize);
+			int row = (int)std::floor((bounds.y[i] - m_Origin.y) / m_CellSize);
+			bool fits = bounds.radius[i] <= m_CellSize && column >= 0 && column < m_Columns && row >= 0 && row < m_Rows;
+			m_CellOf[i] = fits ? (uint32_t)(row * m_Columns + column) : NoCell;
+		}
+	});
+
+	// counting sort by cell: count into [cell + 1], prefix sum, then scatter
+	m_CellStart.assign(cellCount + 1, 0);
+	m_Overflow.clear();
+	m_MaxRadius = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (m_CellOf[i] == NoCell)
+			m_Overflow.push_back((uint32_t)i);
+		else
+		{
+			m_CellStart[m_CellOf[i] + 1]++;
+			m_MaxRadius = std::max(m_MaxRadius, bounds.radius[i]);
+		}
+	}
+	for (size_t c = 0; c < cellCount; c++)
+		m_CellStart[c + 1] += m_CellStart[c];
+
+	m_Items.resize(count - m_Overflow.size());
+	for (size_t i = 0; i < count; i++)
+		if (m_CellOf[i] != NoCell)
+			m_Items[m_CellStart[m_CellOf[i]]++] = (uint32_t)i;
+
+	// the scatter advanced every start to the next cell's, shift them back
+	for (size_t c = cellCount; c > 0; c--)
+		m_CellStart[c] = m_CellStart[c - 1];
+	m_CellStart[0] = 0;
+}
+
+bool UniformGrid::CellRange(glm::vec2 min, glm::vec2 max, glm::ivec2& first, glm::ivec2& last) const
+{
+	glm::vec2 from = glm::floor((min - m_Origin) / m_CellSize);
+	glm::vec2 to = glm::floor((max - m_Origin) / m_CellSize);
+	if (to.x < 0.0f || to.y < 0.0f || from.x >= m_Columns || from.y >= m_Rows)
+		return false;
+
+	first = glm::ivec2(std::max(from.x, 0.0f), std::max(from.y, 0.0f));
+	last = glm::ivec2(std::min(to.x, (float)m_Columns - 1), std::min(to.y, (float)m_Rows - 1));
+	return true;
+}
+
+void UniformGrid::QueryBox(const Aabb& box, std::vector<uint32_t>& out) const
+{
+	if (!m_Bounds)
+		return;
+
+	auto test = [&](uint32_t item)
+	{
+		float radius = m_Bounds->radius[item];
+		if (box.DistanceSquared(ItemCenter(item)) <= radius * radius)
+			out.push_back(item);
+	};
+
+	for (uint32_t item : m_Overflow)
+		test(item);
+
+	// centers up to the largest radius outside the box can still reach into it
+	glm::ivec2 first, last;
+	if (!CellRange(glm::vec2(box.min) - m_MaxRadius, glm::vec2(box.max) + m_MaxRadius, first, last))
+		return;
+
+	for (int row = first.y; row <= last.y; row++)
+	{
+		uint32_t begin = m_CellStart[row * m_Columns + first.x], end = m_CellStart[row * m_Columns + last.x + 1];
+		for (uint32_t i = begin; i < end; i++)
+			test(m_Items[i]);
+	}
+}
+
+void UniformGrid::QuerySphere(glm::vec3 center, float radius, std::vector<uint32_t>& out) const
+{
+	if (!m_Bounds)
+		return;
+
+	auto test = [&](uint32_t item)
+	{
+		glm::vec3 d = ItemCenter(item) - center;
+		float reach = radius + m_Bounds->radius[item];
+		if (glm::dot(d, d) <= reach * reach)
+			out.push_back(item);
+	};
+
+	for (uint32_t item : m_Overflow)
+		test(item);
+
+	glm::ivec2 first, last;
+	float reach = radius + m_MaxRadius;
+	if (!CellRange(glm::vec2(center) - reach, glm::vec2(center) + reach, first, last))
+		return;
+
+	// cells of a row are contiguous in m_Items, so a row is one run
+	for (int row = first.y; row <= last.y; row++)
+	{
+		uint32_t begin = m_CellStart[row * m_Columns + first.x], end = m_CellStart[row * m_Columns + last.x + 1];
+		for (uint32_t i = begin; i < end; i++)
+			test(m_Items[i]);
+	}
+}
+
+void UniformGrid::Nearest(glm::vec3 point, size_t k, FrameArena& arena, std::vector<uint32_t>& out) const
+{
+	if (!m_Bounds || k == 0)
+		return;
+
+	typedef std::pair<float, uint32_t> Candidate;
+	FrameVector<Candidate> bestStorage(arena);
+	bestStorage.reserve(k);
+	std::priority_queue<Candidate, FrameVector<Candidate>> best(std::less<Candidate>(), std::move(bestStorage)); // max-heap of the k closest items
+	auto test = [&](uint32_t item)
+	{
+		glm::vec3 d = ItemCenter(item) - point;
+		float distance = glm::dot(d, d);
+		if (best.size() < k)
+			best.push({ distance, item });
+		else if (distance < best.top().first)
+		{
+			best.pop();
+			best.push({ distance, item });
+		}
+	};
+
+	for (uint32_t item : m_Overflow)
+		test(item);
+
+	// rings of cells around the point's cell (clamped onto the grid); centers from ring r on are at least
+	// r - 1 cells away, so once the kth best is closer than that nothing further out can beat it
+	glm::ivec2 center = glm::clamp(glm::ivec2(glm::floor((glm::vec2(point) - m_Origin) / m_CellSize)), glm::ivec2(0), glm::ivec2(m_Columns - 1, m_Rows - 1));
+	int maxRing = std::max(m_Columns, m_Rows);
+	for (int ring = 0; ring <= maxRing; ring++)
+	{
+		float reached = (ring - 1) * m_CellSize;
+		if (ring > 0 && best.size() == k && best.top().first <= reached * reached)
+			break;
+
+		int firstRow = std::max(center.y - ring, 0), lastRow = std::min(center.y + ring, m_Rows - 1);
+		for (int row = firstRow; row <= lastRow; row++)
+		{
+			// the ring's top and bottom rows are whole, the rows between only have their two end cells
+			bool edge = row == center.y - ring || row == center.y + ring;
+			int step = edge ? 1 : 2 * ring;
+			for (int column = center.x - ring; column <= center.x + ring; column += std::max(step, 1))
+			{
+				if (column < 0 || column >= m_Columns)
+					continue;
+
+				int cell = row * m_Columns + column;
+				for (uint32_t i = m_CellStart[cell]; i < m_CellStart[cell + 1]; i++)
+					test(m_Items[i]);
+			}
+		}
+	}
+
+	size_t begin = out.size();
+	out.resize(begin + best.size());
+	for (size_t i = out.size(); i-- > begin;)
+	{
+		out[i] = best.top().second;
+		best.pop();
+	}
+}
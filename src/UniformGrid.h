@@ -0,0 +1,52 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "Aabb.h"
+#include "FrameArena.h"
+#include "InstanceStore.h"
+#include "JobSystem.h"
+
+// Flat grid over the playfield's x/y, for the many small cubes standing on it. Instances go into the
+// cell holding their center (cells are stored back to back, counting sort style), queries widen their
+// search by the largest radius in the grid. Anything bigger than a cell or off the grid (ground plane,
+// big box) goes into an overflow list every query checks. Rebuilding is O(n), so moves just rebuild.
+class UniformGrid
+{
+private:
+	static constexpr uint32_t NoCell = ~0u;
+
+	glm::vec2 m_Origin;
+	float m_CellSize;
+	int m_Columns, m_Rows;
+
+	const BoundingSpheres* m_Bounds;
+
+	std::vector<uint32_t> m_CellStart; // m_Items[m_CellStart[c], m_CellStart[c + 1]) are in cell c
+	std::vector<uint32_t> m_Items;
+	std::vector<uint32_t> m_Overflow;
+	std::vector<uint32_t> m_CellOf; // build scratch
+	float m_MaxRadius;
+
+public:
+	UniformGrid(glm::vec2 origin, float cellSize, int columns, int rows);
+
+	void Build(const BoundingSpheres& bounds, JobSystem& jobs);
+
+	// Instances whose bounding sphere touches the box or sphere, appended to out
+	void QueryBox(const Aabb& box, std::vector<uint32_t>& out) const;
+	void QuerySphere(glm::vec3 center, float radius, std::vector<uint32_t>& out) const;
+	// The k instances with the closest centers to point, closest first. The search heaps live in arena. Searches rings of cells outwards
+	void Nearest(glm::vec3 point, size_t k, FrameArena& arena, std::vector<uint32_t>& out) const;
+
+	inline size_t GetOverflowCount() const { return m_Overflow.size(); }
+	inline int GetColumns() const { return m_Columns; }
+	inline int GetRows() const { return m_Rows; }
+
+private:
+	inline glm::vec3 ItemCenter(uint32_t index) const { return glm::vec3(m_Bounds->x[index], m_Bounds->y[index], m_Bounds->z[index]); }
+	// cells overlapped by [min, max] on x/y, clamped to the grid; false when it misses the grid
+	bool CellRange(glm::vec2 min, glm::vec2 max, glm::ivec2& first, glm::ivec2& last) const;
+};
@@ -1,5 +1,6 @@
 #include "VertexArray.h"
 #include "VertexBufferLayout.h"
+#include "GLState.h"
 #include "renderer.h"
 
 VertexArray::VertexArray()
@@ -9,7 +10,7 @@ VertexArray::VertexArray()
 
 VertexArray::~VertexArray()
 {
-	GLCall(glDeleteVertexArrays(1, &m_RendererID));
+	GLState::DeleteVertexArray(m_RendererID);
 }
 
 void VertexArray::AddBuffer(const VertexBuffer& buffer, const VertexBufferLayout& layout) const
@@ -31,12 +32,10 @@ void VertexArray::AddBuffer(const VertexBuffer& buffer, const VertexBufferLayout
 
 void VertexArray::Bind() const
 {
-	GLCall(glBindVertexArray(m_RendererID));
-
+	GLState::BindVertexArray(m_RendererID);
 }
 
 void VertexArray::Unbind() const
 {
-	GLCall(glBindVertexArray(0));
-
+	GLState::BindVertexArray(0);
 }
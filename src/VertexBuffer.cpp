@@ -1,26 +1,25 @@
 #include "VertexBuffer.h"
+#include "GLState.h"
 #include "renderer.h"
 
 VertexBuffer::VertexBuffer(const void* data, GLuint size)
 {
 	GLCall(glGenBuffers(1, &m_RendererID));
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, m_RendererID));
+	GLState::BindBuffer(GL_ARRAY_BUFFER, m_RendererID);
 	GLCall(glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW));
 }
 
 VertexBuffer::~VertexBuffer()
 {
-	GLCall(glDeleteBuffers(1, &m_RendererID));
+	GLState::DeleteBuffer(m_RendererID);
 }
 
 void VertexBuffer::Bind() const
 {
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, m_RendererID));
-
+	GLState::BindBuffer(GL_ARRAY_BUFFER, m_RendererID);
 }
 
 void VertexBuffer::Unbind() const
 {
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
+	GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
 }
@@ -14,7 +14,11 @@
 // Standard Library
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
 #include <vector>
+#include <algorithm>
 #include <chrono>
 
 // ImGui
@@ -4,30 +4,75 @@
 #include "renderer.h"
 #include "VertexBufferLayout.h"
 #include "Texture.h"
+#include "Framebuffer.h"
+#include "HeadlessContext.h"
+#include "Benchmark.h"
+#include "InstanceStore.h"
+#include "GpuCuller.h"
+#include "CpuCuller.h"
+#include "TransformKernels.h"
+#include "JobSystem.h"
+#include "Simulation.h"
+#include "SpatialIndex.h"
+#include "SceneGraph.h"
+#include "AllocationTracker.h"
+#include "FrameArena.h"
+#include "LightingBuffer.h"
+#include "GLState.h"
+#include "RenderQueue.h"
+#include "Random.h"
 #include "Cubes.h"
 #include "cube_verts.h"
 
 float deltaTime = 0, lastFrame = 0;
 
-long ssboSize = 1000000;
-
-glm::vec3 cameraPos(50.0f, -40.0f, 60.0f);
-float pitch = 46.0f, yaw = 0.0f, roll = 0.0f, fov = 45.0f;
 float windowWidth = 1280, windowHeight = 720;
 
-glm::vec3 forward(0.0, 0.0, -1.0), up(0.0, 1.0, 0.0), left(-1.0, 0.0, 0.0);
-glm::quat quaternion(1, 0, 0, 0);
+// camera, light orbit and cube spin advance at this rate on the simulation thread
+static constexpr float SimulationRate = 60.0f;
+// of the scene's projection, draw depths in render keys are relative to it
+static constexpr float FarPlane = 2000.0f;
+// buffers, caches and ImGui windows grow over the first frames and the ones after an edit, allocation
+// checks start once that many frames went by without one
+static constexpr uint64_t AllocationSettleFrames = 10;
+static constexpr uint32_t NoWorldIndex = ~0u;
 
 
-struct SSBOIDs
+enum class CullMode
 {
-	GLuint matrixBuffer;
-	GLuint colorsBuffer;
+	None,
+	Gpu,
+	Cpu,
+	Hiz, // gpu frustum + two phase occlusion
+	CpuOcclusion // cpu frustum + software rasterized occluders
 };
-struct SSBOArrays
+static const char* CullModeNames[] = { "none", "gpu", "cpu", "hiz", "cpu-occlusion" };
+
+struct LaunchOptions
 {
-	std::vector<glm::mat4> MatrixArray;
-	std::vector<glm::vec4> ColorsArray;
+	bool headless = false;
+	int benchFrames = 0; // 0 runs interactively
+	int sceneCubes = 0; // random cubes added on top of the default scene
+	long long seed = -1; // -1 seeds from the clock
+	bool compact = false; // start with the 28 B instance format
+	CullMode cull = CullMode::Gpu;
+	int workers = -1; // job system threads besides the main one, -1 leaves one hardware thread to each
+	bool spin = false; // rotate every cube each tick, rebuilding all their matrices
+	bool morton = false; // keep instances sorted along the Morton curve
+	AllocationCheck allocationCheck = AllocationCheck::Off; // count or break on heap allocations in steady-state frames
+	int benchTransforms = 0; // matrices for the transform microbenchmark, runs instead of the app
+};
+
+// The instanced pass's per frame uniforms, resolved once for each instance format's program. Lighting
+// comes from the LightingParams block
+struct InstancedUniforms
+{
+	Uniform<int> culled, highlighted;
+
+	explicit InstancedUniforms(const Shader& shader)
+		: culled(shader.GetUniform<int>("u_Culled")), highlighted(shader.GetUniform<int>("u_Highlighted"))
+	{
+	}
 };
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -40,23 +85,65 @@ long long GetMilli()
 {
 	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
+// seconds since startup, doesn't need GLFW so it also works headless
+float GetSeconds()
+{
+	static const auto start = std::chrono::steady_clock::now();
+	return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
 
 // forward declares
-void AddCube(std::vector<Cubes>& world, SSBOArrays& ssbo, Cubes obj);
-void UpdateInstanceBuffer(SSBOIDs bufferIDs, SSBOArrays bufferArrays);
-void RotateAround2D(glm::vec2 inPos, float inRadius, float inAngle, glm::vec2& outPos);
-
-int main(void)
+bool ParseLaunchOptions(int argc, char** argv, LaunchOptions& options);
+void AddCube(std::vector<InstanceHandle>& world, InstanceStore& instances, const Cubes& obj, uint8_t flags = 0);
+void SpawnCubes(std::vector<InstanceHandle>& world, InstanceStore& instances, Random& random, size_t count, float height);
+void TrackCubes(Simulation& simulation, const InstanceStore& instances, const std::vector<InstanceHandle>& world, size_t first);
+void AttachCubes(SceneGraph& sceneGraph, SceneNode parent, std::vector<InstanceHandle>& world, InstanceStore& instances, size_t first, size_t count);
+void IndexWorld(const std::vector<InstanceHandle>& world, std::vector<uint32_t>& worldIndexOf, size_t first);
+
+int main(int argc, char** argv)
 {
-	GLFWwindow* window;
+	LaunchOptions options;
+	if (!ParseLaunchOptions(argc, argv, options))
+		return -1;
+
+	// per frame CPU work (transforms, culling, upload packing) runs on these plus the main thread
+	if (options.workers < 0)
+		options.workers = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+	JobSystem jobs(options.workers);
+	int workerCount = jobs.GetWorkerCount();
+	// scratch that only lives for the frame, one sub-arena per job thread
+	FrameArena frameArena(jobs.GetThreadCount());
+
+	if (options.benchTransforms > 0)
+	{
+		RunTransformBenchmark(jobs, options.benchTransforms, options.seed < 0 ? 0 : (unsigned int)options.seed);
+		return 0;
+	}
+
+	GLFWwindow* window = nullptr;
+	HeadlessContext headlessContext;
 
 	// GLFW/GLAD/ImGui setup
+	const char* glsl_version("#version 460");
+	if (options.headless)
+	{
+		if (!headlessContext.Create(4, 6))
+			return -1;
+
+		if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress))
+		{
+			std::cout << "failed to initialize glad" << std::endl;
+			return -1;
+		}
+		else
+			std::cout << glGetString(GL_VERSION) << " (" << glGetString(GL_RENDERER) << ", headless)" << std::endl;
+	}
+	else
 	{
 		// GLFW
 		if (!glfwInit())
 			return -1;
 
-		const char* glsl_version("#version 460");
 		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
 		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -82,7 +169,7 @@ int main(void)
 
 		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-		glfwSwapInterval(1); // VSYNC
+		glfwSwapInterval(options.benchFrames > 0 ? 0 : 1); // VSYNC, off when benchmarking
 		glfwSetCursorPos(window, 1280 / 2, 720 / 2);
 
 		// Glad
@@ -93,29 +180,42 @@ int main(void)
 		}
 		else
 			std::cout << glGetString(GL_VERSION) << std::endl;
-		
-		// ImGui
+	}
+
+	// ImGui
+	{
+		// its allocations count towards the frame's too
+		ImGui::SetAllocatorFunctions(TrackedMalloc, TrackedFree);
 		ImGui::CreateContext();
 		ImGuiIO& io = ImGui::GetIO(); (void)io;
 
 		ImGui::StyleColorsDark();
 
-		ImGui_ImplGlfw_InitForOpenGL(window, true);
+		// headless runs have no platform backend, display size is fed by hand every frame
+		if (window)
+			ImGui_ImplGlfw_InitForOpenGL(window, true);
 		ImGui_ImplOpenGL3_Init(glsl_version);
 	}
 
-	GLCall(glEnable(GL_BLEND));
-	GLCall(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
-	GLCall(glEnable(GL_DEPTH_TEST));
-	//GLCall(glEnable(GL_CULL_FACE));
-	GLCall(glEnable(GL_MULTISAMPLE));
+	// nothing to present to without a window, render into an offscreen target instead
+	Framebuffer* offscreenTarget = nullptr;
+	if (options.headless)
+		offscreenTarget = new Framebuffer(windowWidth, windowHeight, 4);
+
+	// the context is fresh, but ImGui's init may have touched bindings already
+	GLState::Invalidate();
+	GLState::Enable(GL_BLEND);
+	GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::Enable(GL_DEPTH_TEST);
+	//GLState::Enable(GL_CULL_FACE);
+	GLState::Enable(GL_MULTISAMPLE);
 
 	GLuint VBO, VAO;
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	GLState::BindVertexArray(VAO);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(cubePos), cubePos, GL_STATIC_DRAW);
 
 	//position attribute
@@ -125,8 +225,8 @@ int main(void)
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
 	
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::BindVertexArray(0);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
 
 
 	Shader shader("res/shaders/basic.shader");
@@ -141,96 +241,120 @@ int main(void)
 	glm::vec3 lightPos(50.0f, 50.0f, 5.0f);
 
 	Shader instanceShader("res/shaders/instanced.shader");
-	instanceShader.Bind();
-	instanceShader.SetUniform4f("u_LightColor", lightColor);
-	instanceShader.SetUniform3f("u_lightpos", lightPos);
-	instanceShader.Unbind();
-
+	Shader compactShader("res/shaders/instanced_compact.shader");
 	Shader lightsourceShader("res/shaders/lightsource.shader");
-	lightsourceShader.Bind();
-	lightsourceShader.SetUniform4f("u_LightColor", lightColor);
-	lightsourceShader.Unbind();
+	// light and material parameters of all three, at uniform buffer binding 2
+	LightingBuffer lighting(2);
+
+	// frame loop uniforms are looked up here once, setting them is just the GL call
+	InstancedUniforms instanceUniforms(instanceShader), compactUniforms(compactShader);
+	Uniform<int> uniformScaleUniform = instanceShader.GetUniform<int>("u_UniformScale");
+	Uniform<glm::mat4> lightModelUniform = lightsourceShader.GetUniform<glm::mat4>("u_ModelMatrix");
+	Uniform<glm::mat4> lightViewUniform = lightsourceShader.GetUniform<glm::mat4>("u_ViewMatrix");
+	Uniform<glm::mat4> lightProjectionUniform = lightsourceShader.GetUniform<glm::mat4>("u_ProjectionMatrix");
 
 	glm::vec3 viewTrans(0.0f, 0.0f, 0.0f);
 	//glm::mat4 projectionMatrix = glm::ortho(0.0f, 16.0f, 0.0f, 9.0f, -1.0f, 1.0f);
 	glm::mat4 projectionMatrix = glm::perspective(glm::radians(45.0f), windowWidth / windowHeight, 0.1f, 200.0f);
 	glm::mat4 viewMatrix = glm::translate(glm::mat4(1.0f), viewTrans);
 
-	std::vector<Cubes> World;
-	SSBOArrays SSBO;
+	// SSBO stuff
+	// GPU buffers are sized to the scene on first upload, edits are staged through a persistently mapped ring
+	InstanceStore Instances(jobs, 0, 2, 3);  // SSBO - Matrices at binding 0, Colors at binding 2, compact instances at binding 3
+	if (options.compact)
+		Instances.SetFormat(InstanceFormat::Compact);
+	std::vector<InstanceHandle> World;
+	// handle -> position in World, NoWorldIndex for unused handles
+	std::vector<uint32_t> WorldIndexOf;
+
+	// visible instance ids at binding 4, the indirect draw commands at binding 5, occlusion rejects at binding 6
+	GpuCuller culler("res/shaders/cull.shader", "res/shaders/depth_pyramid.shader", 4, 5, 6);
+	CullMode cullMode = options.cull;
+	bool occlusionRetest = true;
+
+	// same visible binding, a slice per job system thread
+	CpuCuller cpuCuller(jobs, 4);
+
+	// a cell per unit of the 100x100 playfield (cubes stand on whole coordinates), BVH over everything
+	SpatialIndex spatial(jobs, glm::vec2(-0.5f), 1.0f, 101, 101);
 	
+	// transform hierarchy over some of the cubes, moving a node moves everything below it
+	SceneGraph sceneGraph(jobs);
+	SceneNode groupNode;
+	size_t groupCubes = 0;
+
 	glm::vec3 boxPos(50.0f, 50.0f, 2.0f);
 	{
 		// Plane
-		AddCube(World, SSBO, Cubes(glm::vec3(50.0f, 50.0f, 0.5f), glm::vec3(101.0f, 101.0f, 0.5f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)));
+		AddCube(World, Instances, Cubes(glm::vec3(50.0f, 50.0f, 0.5f), glm::vec3(101.0f, 101.0f, 0.5f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)), InstanceFlag_Occluder);
 
 		// Corner boxes
-		AddCube(World, SSBO, Cubes(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0), glm::vec3(0.0), glm::vec4(1.0)));
-		AddCube(World, SSBO, Cubes(glm::vec3(100.0f, 0.0f, 1.0f), glm::vec3(1.0), glm::vec3(0.0), glm::vec4(1.0)));
-		AddCube(World, SSBO, Cubes(glm::vec3(100.0f, 100.0f, 1.0f), glm::vec3(1.0), glm::vec3(0.0), glm::vec4(1.0)));
-		AddCube(World, SSBO, Cubes(glm::vec3(0.0f, 100.0f, 1.0f), glm::vec3(1.0), glm::vec3(0.0), glm::vec4(1.0)));
+		AddCube(World, Instances, Cubes(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0), glm::vec3(0.0), glm::vec4(1.0)));
+		AddCube(World, Instances, Cubes(glm::vec3(100.0f, 0.0f, 1.0f), glm::vec3(1.0), glm::vec3(0.0), glm::vec4(1.0)));
+		AddCube(World, Instances, Cubes(glm::vec3(100.0f, 100.0f, 1.0f), glm::vec3(1.0), glm::vec3(0.0), glm::vec4(1.0)));
+		AddCube(World, Instances, Cubes(glm::vec3(0.0f, 100.0f, 1.0f), glm::vec3(1.0), glm::vec3(0.0), glm::vec4(1.0)));
 
 		// Central box
-		AddCube(World, SSBO, Cubes(boxPos, glm::vec3(3.0), glm::vec3(0.0f), glm::vec4(1.0, 0.0, 0.37, 1.0)));
+		AddCube(World, Instances, Cubes(boxPos, glm::vec3(3.0), glm::vec3(0.0f), glm::vec4(1.0, 0.0, 0.37, 1.0)), InstanceFlag_Occluder);
+
+		// an empty pivot at the box, so cubes attached to the group don't inherit its scale
+		groupNode = sceneGraph.Create(NoSceneNode, { boxPos, glm::vec3(1.0f), glm::vec3(0.0f) });
+		sceneGraph.Create(groupNode, { glm::vec3(0.0f), glm::vec3(3.0f), glm::vec3(0.0f) }, World.back());
 	}
+
+	// spawn seed, ms since epoch unless the run has to be reproducible
+	if (options.seed < 0)
+		options.seed = options.benchFrames > 0 ? 0 : GetMilli();
+	Random spawnRandom((uint64_t)options.seed);
+
+	// Scene requested on the command line
+	SpawnCubes(World, Instances, spawnRandom, options.sceneCubes, 1.0f);
 	
 	Cubes light(lightPos, glm::vec3(0.5), glm::vec3(1.0), lightColor);
 
-	Renderer renderer;
-
-	// SSBO stuff
-	SSBOIDs BufferIDs;
+	// from here on camera, light orbit and spin belong to the simulation thread, frames draw its latest snapshot
+	Simulation simulation(SimulationRate);
+	simulation.Post([boxPos, lightPos, spin = options.spin](SimulationState& state)
 	{
-		// SSBO - Matrices
-		glGenBuffers(1, &BufferIDs.matrixBuffer);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, BufferIDs.matrixBuffer);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, ssboSize * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, BufferIDs.matrixBuffer);
-
-		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, SSBO.MatrixArray.size() * sizeof(glm::mat4), SSBO.MatrixArray.data());
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-		// SSBO - Colors
-		glGenBuffers(1, &BufferIDs.colorsBuffer);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, BufferIDs.colorsBuffer);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, ssboSize * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, BufferIDs.colorsBuffer);
-
-		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, SSBO.ColorsArray.size() * sizeof(glm::mat4), SSBO.ColorsArray.data());
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-	
-		UpdateInstanceBuffer(BufferIDs, SSBO);
-	}
+		state.light.center = boxPos;
+		state.light.position = lightPos;
+		state.spin.enabled = spin;
+	});
+	TrackCubes(simulation, Instances, World, 0);
+	IndexWorld(World, WorldIndexOf, 0);
+	simulation.Start();
+	uint64_t appliedTick = 0;
+
+	Renderer renderer;
+	RenderQueue renderQueue;
 
 	// UBO stuff
 	GLuint uboMatrices;
 	{
 		glGenBuffers(1, &uboMatrices);
 
-		glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-		glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+		GLState::BindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
+		glBufferData(GL_UNIFORM_BUFFER, 3 * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
 
-		glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0, 2 * sizeof(glm::mat4));
+		GLState::BindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0, 3 * sizeof(glm::mat4));
 
-		projectionMatrix = glm::perspective(glm::radians(fov), 1280.0f / 720.0f, 0.1f, 200.0f);
-		glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
+		projectionMatrix = glm::perspective(glm::radians(CameraState().fov), 1280.0f / 720.0f, 0.1f, 200.0f);
+		GLState::BindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
 		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projectionMatrix));
 
 
 		glm::mat4 rotationMatrix = glm::eulerAngleYXZ(0, 0, 0);
-		glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), cameraPos);
+		glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), CameraState().position);
 
 		viewMatrix = rotationMatrix * translationMatrix;
 
-		glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
+		GLState::BindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
 		glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(viewMatrix));
-		glBindBufferBase(GL_UNIFORM_BUFFER, 1, uboMatrices);
-
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
+		glBufferSubData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(viewProjectionMatrix));
+		GLState::BindBufferBase(GL_UNIFORM_BUFFER, 1, uboMatrices);
 	}
 
-	srand(GetMilli()); // setting rand() seed to ms since epoch
-
 	// Variables declared before main loop
 	float increment = 0.05f;
 	bool isWireframe = false;
@@ -240,293 +364,318 @@ int main(void)
 	ImGuiIO& io = ImGui::GetIO();
 
 	int input = 0;
-	float angle = 0.0f, radius = 10.0f, speed = 1.0f;
-	bool rotateAroundXY = true, rotateAroundXZ = false, rotateAroundYZ = false, paused = false, reverse = false;
-	bool mouseMovement = false, mouseMovementOverride = true, flightMode = true;
-	glm::vec3 savedPosition;
+	int attachInput = 1000;
+	int editIndex = 0;
+	size_t uploadedBytes = 0;
+	float spawnMs = 0.0f;
+	bool mortonOrder = options.morton;
+	float sortMs = -1.0f;
+	float queryRadius = 5.0f;
+	PickHit pick;
+	float pickMs = -1.0f;
+	bool highlightEdited = false;
+	std::vector<uint32_t> queryResults;
+	// the light wanders into denser spots over time, growing this then would allocate in a steady frame
+	queryResults.reserve(16 * 1024);
+	bool mouseMovement = false, mouseMovementOverride = true;
 	float specularStrength = 0.5, specularShininess = 32;
 
 	float pointLight_Constant = 1.0f;
 	float pointLight_Linear = 0.09f;
 	float pointLight_Quadratic = 0.002f;
-	
-	float cameraSpeed = 10.0f;
+
+	Benchmark* benchmark = nullptr;
+	if (options.benchFrames > 0)
+	{
+		benchmark = new Benchmark(options.benchFrames);
+		std::cout << "Benchmark: " << options.benchFrames << " frames, " << World.size() << " cubes, seed " << options.seed << std::endl;
+	}
+
+	bool running = true;
+	SetAllocationCheck(options.allocationCheck);
+	uint64_t frameIndex = 0;
+	uint64_t settledFrame = AllocationSettleFrames;
+	uint64_t settledLayout = Instances.GetLayoutVersion();
 
 	/* Loop until the user closes the window */
-	while (!glfwWindowShouldClose(window))
+	while (running)
 	{
 		// Frame reset stuff
 		{
+			if (benchmark)
+				benchmark->BeginFrame();
+
+			// GL work jobs queued for the main thread since the last frame
+			jobs.RunMainThreadJobs();
+
+			if (offscreenTarget)
+				offscreenTarget->Bind();
+
 			renderer.Clear();
 
-			float currentFrame = glfwGetTime();
+			float currentFrame = GetSeconds();
 			deltaTime = currentFrame - lastFrame;
 			lastFrame = currentFrame;
 
 			ImGui_ImplOpenGL3_NewFrame();
-			ImGui_ImplGlfw_NewFrame();
+			if (window)
+				ImGui_ImplGlfw_NewFrame();
+			else
+			{
+				io.DisplaySize = ImVec2(windowWidth, windowHeight);
+				io.DeltaTime = deltaTime > 0.0f ? deltaTime : 1.0f / 60.0f;
+			}
 			ImGui::NewFrame();
+
+			// clicks, drags and typing edit the world (commands, spawns, bigger buffers), that isn't steady state
+			if (ImGui::IsAnyItemActive() || ImGui::IsMouseDown(ImGuiMouseButton_Left) || ImGui::IsMouseDown(ImGuiMouseButton_Right) || io.WantTextInput || Instances.GetLayoutVersion() != settledLayout)
+			{
+				settledFrame = frameIndex + AllocationSettleFrames;
+				settledLayout = Instances.GetLayoutVersion();
+			}
+			if (frameIndex++ >= settledFrame)
+				BeginTrackedFrame();
 		}
 
 		//Process inputs
 		{
-
 			if (ImGui::IsKeyDown(ImGuiKey_Escape))
-				glfwSetWindowShouldClose(window, true);
-
-			if (ImGui::IsKeyDown(ImGuiKey_W))
-				cameraPos += cameraSpeed * forward;
-
-			if (ImGui::IsKeyDown(ImGuiKey_S))
-				cameraPos -= cameraSpeed * forward;
-
-			if (ImGui::IsKeyDown(ImGuiKey_A))
-				cameraPos -= cameraSpeed * glm::normalize(glm::cross(forward, up));
-
-			if (ImGui::IsKeyDown(ImGuiKey_D))
-				cameraPos += cameraSpeed * glm::normalize(glm::cross(forward, up));
-
-			if (ImGui::IsKeyDown(ImGuiKey_Q))
-				roll += cameraSpeed;
+				running = false;
 
-			if (ImGui::IsKeyDown(ImGuiKey_E))
-				roll -= cameraSpeed;
-		}
-
-		// Set view and projection matrices through Uniform buffers
-		{
 			if (ImGui::IsKeyDown(ImGuiKey_LeftCtrl))
 				mouseMovement = false;
 			else
 				mouseMovement = true;
 
-			if(mouseMovementOverride)
+			if(mouseMovementOverride && window)
 				glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-
-
-			if (mouseMovement && !mouseMovementOverride)
-			{
+			if (mouseMovement && !mouseMovementOverride && window)
 				glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
-				yaw += io.MouseDelta.x;
-				pitch -= io.MouseDelta.y;
-				if (pitch > 89.0f)
-					pitch = 89.0f;
-				if (pitch < -89.0f)
-					pitch = -89.0f;
-				fov -= 2 * io.MouseWheel;
-				if (fov < 1.0f)
-					fov = 1.0f;
-				if (fov > 90.0f)
-					fov = 90.0f;
-			}
 
-			projectionMatrix = glm::perspective(glm::radians(fov), windowWidth / windowHeight, 0.1f, 2000.0f);
-			glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projectionMatrix));
+			// the simulation moves the camera on its next tick
+			SimulationInput input;
+			input.forward = ImGui::IsKeyDown(ImGuiKey_W);
+			input.back = ImGui::IsKeyDown(ImGuiKey_S);
+			input.left = ImGui::IsKeyDown(ImGuiKey_A);
+			input.right = ImGui::IsKeyDown(ImGuiKey_D);
+			input.rollLeft = ImGui::IsKeyDown(ImGuiKey_Q);
+			input.rollRight = ImGui::IsKeyDown(ImGuiKey_E);
+			input.mouseLook = mouseMovement && !mouseMovementOverride;
+			input.mouseDelta = glm::vec2(io.MouseDelta.x, io.MouseDelta.y);
+			input.wheel = io.MouseWheel;
+			simulation.SetInput(input);
+		}
 
-			float radPitch = glm::radians(pitch), radYaw = glm::radians(yaw), radRoll = glm::radians(roll);
+		// Latest simulation snapshot. Its instance deltas only apply once it has seen every world edit we posted,
+		// until then the next snapshot carries them again
+		simulation.Acquire();
+		const FrameSnapshot& snapshot = simulation.GetSnapshot();
+		if (snapshot.tick > appliedTick && snapshot.worldEdits == simulation.GetPostedWorldEdits())
+		{
+			if (!snapshot.deltaHandles.empty())
+				Instances.SetRotations(snapshot.deltaHandles.data(), snapshot.deltaRotations.data(), snapshot.deltaMatrices.data(), snapshot.deltaHandles.size());
+			appliedTick = snapshot.tick;
+			simulation.Acknowledge(appliedTick);
+		}
 
-			if (!flightMode)
+		// bound cubes follow their moved parents, the simulation's copy of them too
+		sceneGraph.Update(Instances);
+		if (!sceneGraph.GetChangedInstances().empty())
+		{
+			simulation.PostWorldEdit([handles = sceneGraph.GetChangedInstances(), transforms = sceneGraph.GetChangedTransforms()](SimulationState& state)
 			{
-				quaternion = glm::quat(1.0, 0.0, 0.0, 0.0);
-				forward = glm::vec3(0.0, 0.0, -1);
-				up = glm::vec3(0.0, 1.0, 0.0);
-				left = glm::vec3(-1.0, 0.0, 0.0);
-			}
+				for (size_t i = 0; i < handles.size(); i++)
+					state.instances.SetTransform(handles[i], transforms[i]);
+			});
+		}
 
-			{
-				float x = forward.x * sin(radRoll / 2);
-				float y = forward.y * sin(radRoll / 2);
-				float z = forward.z * sin(radRoll / 2);
-				float w = cos(radRoll / 2);
-				glm::quat q = glm::quat(w, x, y, z);
-				quaternion *= q;
-				forward = forward * q;
-				up = up * q;
-				left = left * q;
-			}
-			{
-				float x = left.x * sin(radPitch / 2);
-				float y = left.y * sin(radPitch / 2);
-				float z = left.z * sin(radPitch / 2);
-				float w = cos(radPitch / 2);
-				glm::quat q = glm::quat(w, x, y, z);
-				quaternion *= q;
-				forward = forward * q;
-				up = up * q;
-				left = left * q;
-			}
-			{
-				float x = up.x * sin(radYaw / 2);
-				float y = up.y * sin(radYaw / 2);
-				float z = up.z * sin(radYaw / 2);
-				float w = cos(radYaw / 2);
-				glm::quat q = glm::quat(w, x, y, z);
-				quaternion *= q;
-				forward = forward * q;
-				up = up * q;
-				left = left * q;
-			}
+		// re-sorted after enough spawns and removals, the spatial index rebuilds on the new order
+		if (mortonOrder && Instances.IsSpatialOrderStale())
+		{
+			auto start = std::chrono::steady_clock::now();
+			Instances.SortSpatially();
+			sortMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
 
-			if (flightMode) { roll = 0; pitch = 0; yaw = 0; }
-			
+		// spins don't move bounds, so this only does work after spawns, edits and sorts
+		spatial.Update(Instances);
 
-			viewMatrix = glm::toMat4(quaternion) * glm::translate(glm::mat4(1.0), -cameraPos);
+		// Set view and projection matrices through Uniform buffers
+		{
+			projectionMatrix = glm::perspective(glm::radians(snapshot.camera.fov), windowWidth / windowHeight, 0.1f, FarPlane);
+			GLState::BindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projectionMatrix));
+
+			viewMatrix = snapshot.view;
 
-			glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
 			glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(viewMatrix));
-			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			// multiplied once here instead of per vertex
+			glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
+			glBufferSubData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(viewProjectionMatrix));
 		}
 
-		// Draw light source
-			glm::vec3 pos;
+		// Clicking picks the cube under the cursor (the screen center while mouse look hides it) for editing
+		if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && !io.WantCaptureMouse)
 		{
-			glBindVertexArray(VAO);
-			glm::vec2 newPos;
-			glm::vec2 rotateAround;
-			// light box rotation behavior
+			glm::vec2 viewport(windowWidth, windowHeight);
+			glm::vec2 pixel = mouseMovement && !mouseMovementOverride ? viewport * 0.5f : glm::vec2(io.MousePos.x, io.MousePos.y);
+
+			auto start = std::chrono::steady_clock::now();
+			bool picked = spatial.Pick(Instances, pixel, viewport, projectionMatrix, viewMatrix, pick);
+			pickMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (picked && pick.handle < WorldIndexOf.size() && WorldIndexOf[pick.handle] != NoWorldIndex)
 			{
-				if (angle > 360.0f)
-					angle = 0.0f;
-				if (angle < 0.0f)
-					angle = 360.0f;
+				editIndex = (int)WorldIndexOf[pick.handle];
+				highlightEdited = true;
+			}
+		}
 
-				lightPos = boxPos;
+		// only written when something changed, the light moving or the camera turning is enough though
+		{
+			LightingParams params;
+			params.lightColor = light.color;
+			params.lightPosition = snapshot.light.position;
+			params.attenuationConstant = pointLight_Constant;
+			params.attenuationLinear = pointLight_Linear;
+			params.attenuationQuadratic = pointLight_Quadratic;
+			params.viewPosition = snapshot.camera.position;
+			params.specularStrength = specularStrength;
+			params.specularShininess = specularShininess;
+			lighting.Update(params);
+		}
 
-				if (paused)
-				{
-					pos = savedPosition;
-				}
-				if (!paused && !reverse)
-				{
-					float step = 1 * deltaTime;
-					angle += step;
+		// Scene draws are queued with sort keys and flushed once they're all in, the queue orders them by
+		// pass and state and binds only what changes between neighbours
 
-					angle += speed;
-				}
-				if (!paused && reverse)
-				{
-					float step = -1 * deltaTime;
-					angle += step;
-
-					angle -= speed;
-				}
-				if (rotateAroundXY)
-				{
-					pos = lightPos;
-					newPos = glm::vec2(pos.x, pos.y);
-					rotateAround = glm::vec2(boxPos.x, boxPos.y);
+		// Queue light source, its uniforms are program state and set right away
+		{
+			light.position = snapshot.light.position;
+			glm::mat4 modelMatrix = translate(glm::mat4(1.0f), light.position);
+
+			lightsourceShader.SetUniform(lightModelUniform, modelMatrix);
+			lightsourceShader.SetUniform(lightViewUniform, viewMatrix);
+			lightsourceShader.SetUniform(lightProjectionUniform, projectionMatrix);
+
+			RenderCommand command;
+			command.shader = &lightsourceShader;
+			command.vertexArray = VAO;
+			command.count = 36;
+			float depth = glm::distance(snapshot.camera.position, light.position) / FarPlane;
+			renderQueue.Submit(MakeRenderKey(RenderPass::Opaque, false, lightsourceShader.m_RendererID, 0, VAO, depth), std::move(command));
+		}
 
-					RotateAround2D(rotateAround, radius, glm::radians(angle), newPos);
-					pos.x = newPos.x;
-					pos.y = newPos.y;
-				}
-				if (rotateAroundXZ)
-				{
-					pos = lightPos;
-					newPos = glm::vec2(pos.x, pos.z);
-					rotateAround = glm::vec2(boxPos.x, boxPos.z);
+		// Queue instanced objects
+		{
+			uploadedBytes = Instances.Upload();
+
+			bool compact = Instances.GetFormat() == InstanceFormat::Compact;
+			bool culled = cullMode != CullMode::None;
+			bool gpuCulled = cullMode == CullMode::Gpu || cullMode == CullMode::Hiz;
+			bool cpuCulled = cullMode == CullMode::Cpu || cullMode == CullMode::CpuOcclusion;
+			if (gpuCulled)
+				culler.Cull(Instances.Size(), compact, 36, cullMode == CullMode::Hiz);
+			else if (cpuCulled)
+				cpuCuller.Cull(Instances, viewMatrix, projectionMatrix, cullMode == CullMode::CpuOcclusion);
+
+			Shader& activeShader = compact ? compactShader : instanceShader;
+			const InstancedUniforms& uniforms = compact ? compactUniforms : instanceUniforms;
+
+			if (!compact)
+				instanceShader.SetUniform(uniformScaleUniform, Instances.HasUniformScale());
+			activeShader.SetUniform(uniforms.culled, culled);
+			bool highlight = highlightEdited && editIndex < (int)World.size();
+			activeShader.SetUniform(uniforms.highlighted, highlight ? (int)Instances.GetIndex(World[editIndex]) : -1);
+
+			// spans the whole playfield, it goes after the nearer draws
+			RenderCommand command;
+			command.shader = &activeShader;
+			command.vertexArray = VAO;
+			if (gpuCulled)
+				command.draw = [&culler]() { culler.Draw(); };
+			else if (cpuCulled)
+				command.draw = [&cpuCuller]() { cpuCuller.Draw(36); };
+			else
+			{
+				command.count = 36;
+				command.instanceCount = (GLsizei)Instances.Size();
+			}
+			uint64_t key = MakeRenderKey(RenderPass::Opaque, false, activeShader.m_RendererID, 0, VAO, 1.0f);
+			renderQueue.Submit(key, std::move(command));
 
-					RotateAround2D(rotateAround, radius, glm::radians(angle), newPos);
-					pos.x = newPos.x;
-					pos.z = newPos.y;
-				}
-				if (rotateAroundYZ)
+			if (cullMode == CullMode::Hiz)
+			{
+				// the early draw is in the depth buffer now, draw whatever it uncovered
+				RenderCommand late;
+				late.shader = &activeShader;
+				late.vertexArray = VAO;
+				bool retest = occlusionRetest;
+				late.draw = [&culler, &activeShader, retest]()
 				{
-					pos = lightPos;
-					newPos = glm::vec2(pos.y + radius, pos.z);
-					rotateAround = glm::vec2(boxPos.y, boxPos.z);
-
-					RotateAround2D(rotateAround, radius, glm::radians(angle), newPos);
-					pos.y = newPos.x;
-					pos.z = newPos.y;
-				}
+					culler.CullLate(retest);
+					if (retest)
+					{
+						activeShader.Bind();
+						culler.DrawLate();
+					}
+				};
+				renderQueue.Submit(MakeRenderKey(RenderPass::Late, false, activeShader.m_RendererID, 0, VAO, 1.0f), std::move(late));
 			}
-			lightsourceShader.Bind();
-			glm::mat4 modelMatrix = translate(glm::mat4(1.0f), pos);
-			light.position = pos;
-
-			lightsourceShader.SetUniformMat4f("u_ModelMatrix", modelMatrix);
-			lightsourceShader.SetUniformMat4f("u_ViewMatrix", viewMatrix);
-			lightsourceShader.SetUniformMat4f("u_ProjectionMatrix", projectionMatrix);
-			instanceShader.SetUniform4f("u_LightColor", light.color);
-
-			glDrawArrays(GL_TRIANGLES, 0, 36);
-			lightsourceShader.Unbind();
-			glBindVertexArray(0);
-		}
 
-		// Draw instanced objects
-		{
-			glBindVertexArray(VAO);
-			instanceShader.Bind();
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, BufferIDs.colorsBuffer);
-		
-			instanceShader.SetUniform3f("u_lightpos", light.GetPosition());
-			instanceShader.SetUniform4f("u_LightColor", light.color);
-			instanceShader.SetUniform1f("u_PointLight_Constant", pointLight_Constant);
-			instanceShader.SetUniform1f("u_PointLight_Linear", pointLight_Linear);
-			instanceShader.SetUniform1f("u_PointLight_Quadratic", pointLight_Quadratic);
-		
-			instanceShader.SetUniform3f("u_viewpos", cameraPos);
-			instanceShader.SetUniform1f("u_specularstrength", specularStrength);
-			instanceShader.SetUniform1f("u_specularshininess", specularShininess);
-
-			UpdateInstanceBuffer(BufferIDs, SSBO);
-
-			glDrawArraysInstanced(GL_TRIANGLES, 0, 36, SSBO.MatrixArray.size());
-			instanceShader.Unbind();
-			glBindVertexArray(0);
+			renderQueue.Flush();
+
+			if (gpuCulled)
+				culler.EndFrame();
+			// the last draw reading the lighting block this frame
+			lighting.EndFrame();
 		}
 
 		// ImGui Camera control Window
 		{
 			ImGui::Begin("Camera");
 
-			ImGui::SliderFloat3("cameraPosition", &cameraPos.x, -100.0f, 200.0f);
-			if (flightMode)
+			// edits a copy of the snapshot's camera and hands it back to the simulation
+			CameraState camera = snapshot.camera;
+			bool cameraEdited = ImGui::SliderFloat3("cameraPosition", &camera.position.x, -100.0f, 200.0f);
+			if (camera.flightMode)
 			{
 				ImGui::Text("Flight Mode");
-				ImGui::SliderFloat("Pitch", &pitch, -2.0f, 2.0f);
-				ImGui::SliderFloat("Yaw", &yaw, -2.0f, 2.0f);
-				ImGui::SliderFloat("Roll", &roll, -2.0f, 2.0f);
+				cameraEdited |= ImGui::SliderFloat("Pitch", &camera.pitch, -2.0f, 2.0f);
+				cameraEdited |= ImGui::SliderFloat("Yaw", &camera.yaw, -2.0f, 2.0f);
+				cameraEdited |= ImGui::SliderFloat("Roll", &camera.roll, -2.0f, 2.0f);
 			}
 			else
 			{
 				ImGui::Text("Input Mode (Absolute)");
-				ImGui::SliderFloat("Pitch", &pitch, -180.0f, 180.0f);
-				ImGui::SliderFloat("Yaw", &yaw, -180.0f, 180.0f);
+				cameraEdited |= ImGui::SliderFloat("Pitch", &camera.pitch, -180.0f, 180.0f);
+				cameraEdited |= ImGui::SliderFloat("Yaw", &camera.yaw, -180.0f, 180.0f);
 			}
 
-			ImGui::InputFloat("Camera Speed", &cameraSpeed);
+			cameraEdited |= ImGui::InputFloat("Camera Speed", &camera.speed);
 
 			if (!mouseMovementOverride)
-				ImGui::Text("FOV: %f", fov);
+				ImGui::Text("FOV: %f", camera.fov);
 			else
-				ImGui::SliderFloat("FOV", &fov, 10.0f, 120.0f);
+				cameraEdited |= ImGui::SliderFloat("FOV", &camera.fov, 10.0f, 120.0f);
 
 			if (ImGui::Button("Reset Camera"))
 			{
-				quaternion = glm::quat(1.0, 0.0, 0.0, 0.0);
-				forward = glm::vec3(0.0, 0.0, -1);
-				up = glm::vec3(0.0, 1.0, 0.0);
-				left = glm::vec3(-1.0, 0.0, 0.0);
-				cameraPos = glm::vec3(50.0f, -40.0f, 60.0f); pitch = 46.0f, yaw = 0.0f, roll = 0.0f, fov = 45.0f;
+				camera.Reset(glm::vec3(50.0f, -40.0f, 60.0f), 46.0f);
+				cameraEdited = true;
 			} ImGui::SameLine();
 			if (ImGui::Button("Reset Camera (Top-Down)"))
 			{
-				quaternion = glm::quat(1.0, 0.0, 0.0, 0.0);
-				forward = glm::vec3(0.0, 0.0, -1);
-				up = glm::vec3(0.0, 1.0, 0.0);
-				left = glm::vec3(-1.0, 0.0, 0.0);
-				cameraPos = glm::vec3(50.0f, 50.0f, 130.0f); pitch = 0.0f, yaw = 0.0f, roll = 0.0f, fov = 45.0f;
+				camera.Reset(glm::vec3(50.0f, 50.0f, 130.0f), 0.0f);
+				cameraEdited = true;
 			}
 			
 			ImGui::Checkbox("Mouse movement override", &mouseMovementOverride);
 
-			ImGui::Checkbox("Flight Mode", &flightMode);
+			cameraEdited |= ImGui::Checkbox("Flight Mode", &camera.flightMode);
 
-			ImGui::Text("Front Vector: %f %f %f", forward.x, forward.y, forward.z);
+			ImGui::Text("Front Vector: %f %f %f", camera.forward.x, camera.forward.y, camera.forward.z);
+
+			if (cameraEdited)
+				simulation.Post([camera](SimulationState& state) { state.camera = camera; });
 
 			ImGui::End();
 		}
@@ -534,39 +683,38 @@ int main(void)
 		//ImGui light control window
 		{
 			ImGui::Begin("Light");
-			ImGui::SliderFloat3("lightpos", &pos.x, -100.0f, 100.0f);
-			light.position = pos;
+			LightState lightState = snapshot.light;
+			bool lightEdited = ImGui::SliderFloat3("lightpos", &lightState.position.x, -100.0f, 100.0f);
 			ImGui::SliderFloat4("lightcolor RGBA", &light.color.x, 0.0, 1.0);
 			ImGui::Separator();
 
-			//ImGui::SliderFloat2("Rotate around", &rotateAround.x, -100.0f, 100.0f);
-
 			if (ImGui::Button("Rotate on X/Y axis"))
 			{
-				rotateAroundXY = true;
-				rotateAroundXZ = false;
-				rotateAroundYZ = false;
+				lightState.plane = OrbitPlane::XY;
+				lightEdited = true;
 			} ImGui::SameLine();
 			if (ImGui::Button("Rotate on X/Z axis"))
 			{
-				rotateAroundXY = false;
-				rotateAroundXZ = true;
-				rotateAroundYZ = false;
+				lightState.plane = OrbitPlane::XZ;
+				lightEdited = true;
 			} ImGui::SameLine();
 			if (ImGui::Button("Rotate on Y/Z axis"))
 			{
-				rotateAroundXY = false;
-				rotateAroundXZ = false;
-				rotateAroundYZ = true;
+				lightState.plane = OrbitPlane::YZ;
+				lightEdited = true;
 			}
-			ImGui::Checkbox("Freeze in place", &paused); ImGui::SameLine();
-			savedPosition = pos;
-			ImGui::Checkbox("Reverse rotation", &reverse);
-			ImGui::SliderFloat("Angle", &angle, 0.0f, 360.0f); ImGui::SliderFloat("Radius", &radius, 0.0f, 55.0f);  ImGui::SliderFloat("Speed", &speed, 0.001f, 20.0f);
+			lightEdited |= ImGui::Checkbox("Freeze in place", &lightState.paused); ImGui::SameLine();
+			lightEdited |= ImGui::Checkbox("Reverse rotation", &lightState.reverse);
+			lightEdited |= ImGui::SliderFloat("Angle", &lightState.angle, 0.0f, 360.0f);
+			lightEdited |= ImGui::SliderFloat("Radius", &lightState.radius, 0.0f, 55.0f);
+			lightEdited |= ImGui::SliderFloat("Speed", &lightState.speed, 0.001f, 20.0f);
+			if (lightEdited)
+				simulation.Post([lightState](SimulationState& state) { state.light = lightState; });
 
 			ImGui::Separator();
 			ImGui::SliderFloat("Specular Strength", &specularStrength, 0.001f, 1.0f);
 			ImGui::SliderFloat("Object Shininess", &specularShininess, 0, 256);
+			ImGui::Text("Lighting block: %s", lighting.WasWritten() ? "written this frame" : "unchanged");
 
 			ImGui::Separator();
 			ImGui::Text("Point light attenuation variables");
@@ -584,28 +732,178 @@ int main(void)
 
 			if (ImGui::Button("Add 1 Cube"))
 			{
-				AddCube(World, SSBO, Cubes(glm::vec3(rand() % 99, rand() % 99, 1.5f), glm::vec3(1.0, 1.0, 1.0), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec4(1.0, 0.0, 1.0, 1.0)));
-				UpdateInstanceBuffer(BufferIDs, SSBO);
+				size_t first = World.size();
+				SpawnCubes(World, Instances, spawnRandom, 1, 1.5f);
+				TrackCubes(simulation, Instances, World, first);
+				IndexWorld(World, WorldIndexOf, first);
 			}
 			ImGui::InputInt("Add X cubes", &input); ImGui::SameLine();
-			if (ImGui::Button("Add"))
+			if (ImGui::Button("Add") && input > 0)
+			{
+				auto start = std::chrono::steady_clock::now();
+				size_t first = World.size();
+				SpawnCubes(World, Instances, spawnRandom, input, 1.0f);
+				TrackCubes(simulation, Instances, World, first);
+				IndexWorld(World, WorldIndexOf, first);
+				spawnMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+			if (spawnMs > 0.0f)
+				ImGui::Text("Last spawn: %.2f ms", spawnMs);
+
+			if (GetAllocationCheck() != AllocationCheck::Off)
+				ImGui::Text("Heap allocations last frame: %zu (%zu B)", GetFrameAllocationCount(), GetFrameAllocationBytes());
+			ImGui::Text("Frame arena: %.1f / %.1f KB", frameArena.GetLastFrameBytes() / 1024.0f, frameArena.GetCapacity() / 1024.0f);
+			ImGui::Text("GL state calls: %zu issued, %zu elided", GLState::GetIssuedCalls(), GLState::GetElidedCalls());
+			ImGui::Text("Render queue: %zu draws, %zu state changes", renderQueue.GetLastCommandCount(), renderQueue.GetLastStateChanges());
+			ImGui::Text("Instance upload: %.2f KB/frame", uploadedBytes / 1024.0f);
+			ImGui::Text("Instance buffers: %zu / %zu (%.2f MB)", Instances.Size(), Instances.GetCapacity(), Instances.GetGpuBytes() / (1024.0f * 1024.0f)); ImGui::SameLine();
+			if (ImGui::Button("Shrink to fit"))
+				Instances.ShrinkToFit();
+			bool compact = Instances.GetFormat() == InstanceFormat::Compact;
+			if (ImGui::Checkbox("Compact instance format (28 B)", &compact))
+				Instances.SetFormat(compact ? InstanceFormat::Compact : InstanceFormat::Matrix);
+			ImGui::Checkbox("Morton order", &mortonOrder);
+			if (sortMs >= 0.0f)
+			{
+				ImGui::SameLine();
+				ImGui::Text("last sort %.2f ms", sortMs);
+			}
+			SpinState spin = snapshot.spin;
+			bool spinEdited = ImGui::Checkbox("Spin cubes", &spin.enabled); ImGui::SameLine();
+			spinEdited |= ImGui::SliderFloat("Spin speed", &spin.speed, -5.0f, 5.0f);
+			if (spinEdited)
+				simulation.Post([spin](SimulationState& state) { state.spin = spin; });
+			ImGui::Text("Simulation tick %llu: %.3f ms (%s transforms)", (unsigned long long)snapshot.tick, snapshot.tickMs, GetTransformKernelName());
+			if (ImGui::SliderInt("Job workers", &workerCount, 0, (int)std::thread::hardware_concurrency()))
 			{
-				for (int i = 0; i <= input; i++)
+				jobs.SetWorkerCount(workerCount);
+				frameArena.SetThreadCount(jobs.GetThreadCount());
+			}
+			{
+				// busy share of the last frame, main thread first
+				const std::vector<float>& utilization = jobs.GetUtilization();
+				size_t capacity = 32 + utilization.size() * 8;
+				char* text = frameArena.Allocate<char>(capacity);
+				int length = snprintf(text, capacity, "Job utilization:");
+				for (size_t i = 0; i < utilization.size(); i++)
+					length += snprintf(text + length, capacity - length, "%s%d%%", i == 0 ? " main " : " ", (int)(utilization[i] * 100.0f + 0.5f));
+				ImGui::TextUnformatted(text, text + length);
+			}
+			ImGui::Combo("Culling", (int*)&cullMode, CullModeNames, IM_ARRAYSIZE(CullModeNames));
+			if (cullMode == CullMode::Cpu || cullMode == CullMode::CpuOcclusion)
+			{
+				ImGui::Text("CPU cull (%s): %.3f ms, %zu / %zu visible", cpuCuller.GetKernelName(), cpuCuller.GetCullMs(), cpuCuller.GetVisibleCount(), Instances.Size());
+				if (cullMode == CullMode::CpuOcclusion)
+					ImGui::Text("Occluders: %zu, occluded: %zu", cpuCuller.GetOccluderCount(), cpuCuller.GetOccludedCount());
+			}
+			else if (cullMode == CullMode::Gpu || cullMode == CullMode::Hiz)
+			{
+				const CullStats& stats = culler.GetStats();
+				if (cullMode == CullMode::Hiz)
+					ImGui::Checkbox("Late pass (retest occlusion rejects)", &occlusionRetest);
+				ImGui::Text("Frustum culled: %zu, occluded: %zu", stats.frustumCulled, stats.occluded);
+				ImGui::Text("Drawn: %zu early + %zu late / %zu", stats.earlyDrawn, stats.lateDrawn, stats.instances);
+			}
+
+			ImGui::Separator();
+			{
+				const Bvh& bvh = spatial.GetBvh();
+				ImGui::Text("BVH: %zu nodes, SAH cost %.1f, last %s %.3f ms", bvh.GetNodeCount(), bvh.GetSahCost(), spatial.WasRebuilt() ? "build" : "refit", spatial.GetUpdateMs());
+				ImGui::Text("Grid: %i x %i cells, %zu overflow", spatial.GetGrid().GetColumns(), spatial.GetGrid().GetRows(), spatial.GetGrid().GetOverflowCount());
+
+				// both structures answer the same questions, they should agree
+				ImGui::SliderFloat("Light query radius", &queryRadius, 0.0f, 50.0f);
+				queryResults.clear();
+				bvh.QuerySphere(snapshot.light.position, queryRadius, queryResults);
+				size_t bvhNear = queryResults.size();
+				queryResults.clear();
+				spatial.GetGrid().QuerySphere(snapshot.light.position, queryRadius, queryResults);
+				ImGui::Text("Cubes near light: %zu (grid %zu)", bvhNear, queryResults.size());
+
+				queryResults.clear();
+				bvh.Nearest(snapshot.light.position, 1, frameArena, queryResults);
+				spatial.GetGrid().Nearest(snapshot.light.position, 1, frameArena, queryResults);
+				if (queryResults.size() == 2)
+					ImGui::Text("Nearest to light: instance %u (grid %u)", queryResults[0], queryResults[1]);
+			}
+
+			ImGui::Separator();
+			{
+				InstanceStore::Transform group = sceneGraph.GetLocalTransform(groupNode);
+				bool groupMoved = ImGui::SliderFloat3("Group position", &group.position.x, -10.0f, 110.0f);
+				groupMoved |= ImGui::SliderFloat3("Group rotation", &group.rotation.x, -3.14159f, 3.14159f);
+				if (groupMoved)
+					sceneGraph.SetLocalTransform(groupNode, group);
+				ImGui::InputInt("Attach X cubes", &attachInput); ImGui::SameLine();
+				if (ImGui::Button("Attach") && attachInput > 0)
 				{
-					AddCube(World, SSBO, Cubes(glm::vec3(rand() % 99, rand() % 99, 1.0f), glm::vec3(1.0, 1.0, 1.0), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec4(1.0, 0.0, 1.0, 1.0)));
+					size_t first = World.size();
+					AttachCubes(sceneGraph, groupNode, World, Instances, groupCubes, attachInput);
+					TrackCubes(simulation, Instances, World, first);
+					IndexWorld(World, WorldIndexOf, first);
+					groupCubes += attachInput;
 				}
-				UpdateInstanceBuffer(BufferIDs, SSBO);
+				ImGui::Text("Scene graph: %zu nodes, last update %zu nodes in %.3f ms", sceneGraph.Size(), sceneGraph.GetUpdatedCount(), sceneGraph.GetUpdateMs());
 			}
 
 			ImGui::Separator();
-			ImGui::Checkbox("Wireframe mode", &isWireframe);
-			if (isWireframe)
-				glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+			ImGui::InputInt("Edit cube", &editIndex); ImGui::SameLine();
+			ImGui::Checkbox("Highlight", &highlightEdited);
+			if (pickMs >= 0.0f)
+			{
+				if (pick.index != ~0u)
+					ImGui::Text("Picked instance %u at %.2f (%.3f ms), click a cube to edit it", pick.index, pick.distance, pickMs);
+				else
+					ImGui::Text("Picked nothing (%.3f ms), click a cube to edit it", pickMs);
+			}
 			else
-				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+				ImGui::Text("Click a cube to edit it");
+			editIndex = std::clamp(editIndex, 0, std::max((int)World.size() - 1, 0));
+			if (!World.empty())
+			{
+				InstanceHandle edited = World[editIndex];
+				InstanceStore::Transform transform = Instances.GetTransform(edited);
+				glm::vec4 color = Instances.GetColor(edited);
+
+				bool moved = ImGui::SliderFloat3("Position", &transform.position.x, -10.0f, 110.0f);
+				moved |= ImGui::SliderFloat3("Rotation", &transform.rotation.x, -3.14159f, 3.14159f);
+				moved |= ImGui::SliderFloat3("Scale", &transform.scale.x, 0.1f, 10.0f);
+				if (moved)
+				{
+					Instances.SetTransform(edited, transform.position, transform.scale, transform.rotation);
+					simulation.PostWorldEdit([edited, transform](SimulationState& state) { state.instances.SetTransform(edited, transform); });
+				}
+				if (ImGui::ColorEdit4("Color", &color.x))
+					Instances.SetColor(edited, color);
+
+				bool occluder = Instances.GetFlags(edited) & InstanceFlag_Occluder;
+				if (ImGui::Checkbox("Occluder", &occluder))
+				{
+					uint8_t flags = occluder ? InstanceFlag_Occluder : 0;
+					Instances.SetFlags(edited, flags);
+					simulation.PostWorldEdit([edited, flags](SimulationState& state) { state.instances.SetFlags(edited, flags); });
+				}
+				ImGui::SameLine();
+				// other handles stay valid, the store fills the hole with its last instance and so does World
+				if (ImGui::Button("Remove"))
+				{
+					sceneGraph.UnbindInstance(edited);
+					Instances.Remove(edited);
+					simulation.PostWorldEdit([edited](SimulationState& state) { state.instances.Remove(edited); });
+					InstanceHandle last = World.back();
+					World[editIndex] = last;
+					WorldIndexOf[last] = (uint32_t)editIndex;
+					WorldIndexOf[edited] = NoWorldIndex;
+					World.pop_back();
+				}
+			}
+
+			ImGui::Separator();
+			ImGui::Checkbox("Wireframe mode", &isWireframe);
+			GLState::PolygonMode(isWireframe ? GL_LINE : GL_FILL);
 
 			ImGui::Separator();
-			if (ImGui::Button("Reset Window"))
+			if (window && ImGui::Button("Reset Window"))
 			{
 				windowWidth = 1280;
 				windowHeight = 720;
@@ -621,49 +919,193 @@ int main(void)
 
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-		/* Swap front and back buffers */
-		glfwSwapBuffers(window);
-		/* Poll for and process events */
-		glfwPollEvents();
+
+		jobs.EndFrame();
+		GLState::EndFrame();
+
+		if (benchmark)
+		{
+			benchmark->EndFrame();
+			if (benchmark->IsFinished())
+				running = false;
+		}
+		EndTrackedFrame();
+		// after the check: a frame that overflowed the arena reallocates it here
+		frameArena.Reset();
+
+		if (window)
+		{
+			/* Swap front and back buffers */
+			glfwSwapBuffers(window);
+			/* Poll for and process events */
+			glfwPollEvents();
+
+			if (glfwWindowShouldClose(window))
+				running = false;
+		}
 	}
 
+	simulation.Stop();
+
+	if (benchmark)
+	{
+		benchmark->Report();
+		delete benchmark;
+	}
+	delete offscreenTarget;
+
 	ImGui_ImplOpenGL3_Shutdown();
-	ImGui_ImplGlfw_Shutdown();
+	if (window)
+		ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
 	return 0;
 }
-void AddCube(std::vector<Cubes>& world, SSBOArrays& ssbo, Cubes obj)
+
+bool ParseLaunchOptions(int argc, char** argv, LaunchOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--headless")
+			options.headless = true;
+		else if (arg == "--bench" && hasValue)
+			options.benchFrames = atoi(argv[++i]);
+		else if (arg == "--scene" && hasValue)
+			options.sceneCubes = atoi(argv[++i]);
+		else if (arg == "--seed" && hasValue)
+			options.seed = atoll(argv[++i]);
+		else if (arg == "--cull" && hasValue)
+		{
+			std::string mode = argv[++i];
+			auto it = std::find(std::begin(CullModeNames), std::end(CullModeNames), mode);
+			if (it == std::end(CullModeNames))
+			{
+				std::cout << "invalid --cull, expected none, gpu, cpu, hiz or cpu-occlusion" << std::endl;
+				return false;
+			}
+			options.cull = (CullMode)(it - std::begin(CullModeNames));
+		}
+		else if (arg == "--workers" && hasValue)
+			options.workers = atoi(argv[++i]);
+		else if (arg == "--compact")
+			options.compact = true;
+		else if (arg == "--spin")
+			options.spin = true;
+		else if (arg == "--morton")
+			options.morton = true;
+		else if (arg == "--alloc-check" && hasValue)
+		{
+			std::string check = argv[++i];
+			if (check != "report" && check != "assert")
+			{
+				std::cout << "invalid --alloc-check, expected report or assert" << std::endl;
+				return false;
+			}
+			options.allocationCheck = check == "report" ? AllocationCheck::Report : AllocationCheck::Assert;
+		}
+		else if (arg == "--bench-transforms" && hasValue)
+			options.benchTransforms = atoi(argv[++i]);
+		else if (arg == "--size" && hasValue)
+		{
+			int width = 0, height = 0;
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+			{
+				std::cout << "invalid --size, expected WIDTHxHEIGHT" << std::endl;
+				return false;
+			}
+			windowWidth = width;
+			windowHeight = height;
+		}
+		else
+		{
+			std::cout << "usage: " << argv[0] << " [--headless] [--bench FRAMES] [--scene CUBES] [--seed N] [--compact] [--cull none|gpu|cpu|hiz|cpu-occlusion] [--workers N] [--spin] [--morton] [--alloc-check report|assert] [--size WIDTHxHEIGHT] [--bench-transforms MATRICES]" << std::endl;
+			return false;
+		}
+	}
+
+	// without a window there's nothing to look at, so headless always benchmarks
+	if (options.headless && options.benchFrames <= 0)
+		options.benchFrames = 1000;
+
+	return true;
+}
+void AddCube(std::vector<InstanceHandle>& world, InstanceStore& instances, const Cubes& obj, uint8_t flags)
 {
-	world.push_back(obj);
-	ssbo.MatrixArray.push_back(obj.modelMatrix);
-	ssbo.ColorsArray.push_back(obj.color);
+	world.push_back(instances.Add(obj, flags));
 }
 
-template<typename T>
-void UpdateSSBO(GLuint id, const std::vector<T>& data)
+// Unit magenta cubes on random whole positions of the ground, added as one batch
+void SpawnCubes(std::vector<InstanceHandle>& world, InstanceStore& instances, Random& random, size_t count, float height)
 {
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
+	InstanceBatch batch = instances.BeginBatch(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		batch.positions[i] = glm::vec3((float)random.Below(99), (float)random.Below(99), height);
+		batch.scales[i] = glm::vec3(1.0f);
+		batch.rotations[i] = glm::vec3(0.0f);
+		batch.colors[i] = glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
+	}
+	instances.EndBatch(0, world);
+}
 
-	if (data.size() == ssboSize)
+// Cyan cubes on a spiral shell around parent, bound to new child nodes. first continues an earlier spiral.
+// Where they start doesn't matter, the next scene graph update places them
+void AttachCubes(SceneGraph& sceneGraph, SceneNode parent, std::vector<InstanceHandle>& world, InstanceStore& instances, size_t first, size_t count)
+{
+	InstanceBatch batch = instances.BeginBatch(count);
+	for (size_t i = 0; i < count; i++)
 	{
-		ssboSize += ssboSize; // double ssbo size
-		glBufferData(GL_SHADER_STORAGE_BUFFER, ssboSize * sizeof(T), data.data(), GL_DYNAMIC_DRAW);
+		batch.positions[i] = glm::vec3(0.0f);
+		batch.scales[i] = glm::vec3(0.25f);
+		batch.rotations[i] = glm::vec3(0.0f);
+		batch.colors[i] = glm::vec4(0.1f, 0.8f, 1.0f, 1.0f);
 	}
-	else
+	size_t begin = world.size();
+	instances.EndBatch(0, world);
+
+	// golden angle spiral over the sphere, the radius grows with the cube root so the density stays even
+	for (size_t i = 0; i < count; i++)
 	{
-		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.size() * sizeof(data[0]), data.data());
+		double n = (double)(first + i);
+		float z = 1.0f - 2.0f * (float)std::fmod(n * 0.6180339887, 1.0);
+		float ring = std::sqrt(std::max(1.0f - z * z, 0.0f));
+		float angle = (float)std::fmod(n * 2.3999632297, 6.2831853072);
+		float radius = 3.0f + 0.3f * (float)std::cbrt(n);
+		glm::vec3 position = radius * glm::vec3(ring * std::cos(angle), ring * std::sin(angle), z);
+		sceneGraph.Create(parent, { position, glm::vec3(0.25f), glm::vec3(0.0f) }, world[begin + i]);
 	}
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
-void UpdateInstanceBuffer(const SSBOIDs bufferIDs, const SSBOArrays bufferArrays)
+// Records where world[first..] sit in world by handle, handles of removed cubes get reused by new ones
+void IndexWorld(const std::vector<InstanceHandle>& world, std::vector<uint32_t>& worldIndexOf, size_t first)
 {
-	UpdateSSBO(bufferIDs.matrixBuffer, bufferArrays.MatrixArray);
-	UpdateSSBO(bufferIDs.colorsBuffer, bufferArrays.ColorsArray);
+	for (size_t i = first; i < world.size(); i++)
+	{
+		if (world[i] >= worldIndexOf.size())
+			worldIndexOf.resize(world[i] + 1, NoWorldIndex);
+		worldIndexOf[world[i]] = (uint32_t)i;
+	}
 }
 
-void RotateAround2D(glm::vec2 inPos, float inRadius, float inAngle, glm::vec2& outPos)
+// Hands world[first..] to the simulation's copy of the instances
+void TrackCubes(Simulation& simulation, const InstanceStore& instances, const std::vector<InstanceHandle>& world, size_t first)
 {
-	outPos.x = ((cos(inAngle) * inRadius) + inPos.x);
-	outPos.y = ((sin(inAngle) * inRadius) + inPos.y);
+	std::vector<InstanceHandle> handles(world.begin() + first, world.end());
+	std::vector<InstanceStore::Transform> transforms;
+	std::vector<uint8_t> flags;
+	transforms.reserve(handles.size());
+	flags.reserve(handles.size());
+	for (InstanceHandle handle : handles)
+	{
+		transforms.push_back(instances.GetTransform(handle));
+		flags.push_back(instances.GetFlags(handle));
+	}
+
+	simulation.PostWorldEdit([handles = std::move(handles), transforms = std::move(transforms), flags = std::move(flags)](SimulationState& state)
+	{
+		for (size_t i = 0; i < handles.size(); i++)
+			state.instances.Add(handles[i], transforms[i], flags[i]);
+	});
 }
\ No newline at end of file